@@ -3,35 +3,253 @@
 #include <vector>
 #include <fstream>
 #include <iomanip>
+#include <chrono>
+#include <sstream>
 
 #include "AudioRenderingUtils.h"
 #include "Camera.h"
 #include "Scene.h"
 #include "Source.h"
+#include "ImageSource.h"
+#include "SpecularPathFinder.h"
+#include "BeamTracer.h"
+#include "RadianceTransfer.h"
+#include "BidirectionalPathTracer.h"
+#include "PressureSynthesizer.h"
+#include "HybridReverb.h"
+#include "CastCheckpoint.h"
 
 #include "AudioFile.h"
 
+//Range of the measured energy decay curve where the calibration compares the decay (dB). The start skips the direct
+//sound and the end stays above the noise floor of usual measurements.
+#define CALIBRATION_DECAY_BEGIN -5.0
+#define CALIBRATION_DECAY_END -35.0
+//Absorption values tried before refining the best one
+#define CALIBRATION_GRID_STEPS 50
+#define CALIBRATION_TOLERANCE 0.0001
+
+//Energy histogram of paths with one bin per millisecond
+std::vector<double> pathHistogram(audioPaths * paths) {
+	std::vector<double> histogram;
+	forEachAudioPath(paths, [&](const audioPath & path) {
+		unsigned int bin = round(path.travelled_distance / SPEED_OF_SOUND * 1000);
+		if (bin >= histogram.size()) {
+			histogram.resize(bin + 1, 0.0);
+		}
+		histogram[bin] += path.remaining_energy_factor;
+	});
+	return histogram;
+}
+
+/*Traces the same rays in both scenes and reports the change in tracing time and in the response. The response is
+compared with the energy decay curves (Schroeder integral): the largest level difference over the first 60 dB of
+decay. Part of the difference is the noise of the stochastic ray tracing.*/
+void compareScenes(
+	Scene * original,
+	Scene * simplified,
+	glm::vec3 listener_pos,
+	float listener_size,
+	glm::vec3 source_pos,
+	float source_power,
+	int max_reflexions,
+	float absorbtion_coef,
+	int num_rays) {
+
+	Scene * scenes[2] = { original, simplified };
+	std::vector<double> edc[2];
+	double times[2];
+	unsigned long long seed = std::chrono::system_clock::now().time_since_epoch().count();
+	for (int s = 0; s < 2; s++) {
+		audioPaths paths;
+		initAudioPaths(&paths);
+		RayTracer rt = RayTracer(scenes[s], listener_pos, listener_size, source_pos, source_power, &paths, max_reflexions, 1 - absorbtion_coef, num_rays);
+		rt.seed = seed;
+		auto start = std::chrono::high_resolution_clock::now();
+		rt.OmnidirectionalUniformSphereRayCast();
+		auto end = std::chrono::high_resolution_clock::now();
+		times[s] = std::chrono::duration<double, std::milli>(end - start).count();
+
+		edc[s] = pathHistogram(&paths);
+		for (int i = (int)edc[s].size() - 2; i >= 0; i--) {
+			edc[s][i] += edc[s][i + 1];
+		}
+		freeAudioPaths(&paths);
+	}
+
+	size_t length = glm::min(edc[0].size(), edc[1].size());
+	double max_difference = 0;
+	double energy_difference = 0;
+	if (length > 0 && edc[0][0] > 0 && edc[1][0] > 0) {
+		energy_difference = 100 * (edc[1][0] - edc[0][0]) / edc[0][0];
+		for (size_t i = 0; i < length; i++) {
+			double level0 = 10 * log10(edc[0][i] / edc[0][0]);
+			double level1 = 10 * log10(edc[1][i] / edc[1][0]);
+			if (level0 < -60 || edc[1][i] <= 0) {
+				break;
+			}
+			max_difference = glm::max(max_difference, fabs(level0 - level1));
+		}
+	}
+	std::cout << "Simplification: tracing " << times[0] << " ms -> " << times[1] << " ms (x" << times[0] / times[1] << "), "
+		<< "received energy " << energy_difference << "%, max decay curve difference " << max_difference << " dB" << std::endl;
+}
+
+/*Energy decay curve (Schroeder integral) of a histogram, in dB relative to its total energy. It starts at the onset, the
+first bin with at least a hundredth of the energy of the largest one, so curves with different delays can be compared.*/
+std::vector<double> decayCurve(const std::vector<double> & histogram) {
+	double max_energy = 0;
+	for (size_t i = 0; i < histogram.size(); i++) {
+		max_energy = glm::max(max_energy, histogram[i]);
+	}
+	size_t onset = 0;
+	while (onset < histogram.size() && histogram[onset] < max_energy / 100) {
+		onset++;
+	}
+	std::vector<double> curve(histogram.begin() + onset, histogram.end());
+	for (int i = (int)curve.size() - 2; i >= 0; i--) {
+		curve[i] += curve[i + 1];
+	}
+	double total = curve.empty() ? 0 : curve[0];
+	for (size_t i = 0; i < curve.size(); i++) {
+		curve[i] = curve[i] > 0 ? 10 * log10(curve[i] / total) : -200;
+	}
+	return curve;
+}
+
+//RMS level difference (dB) between two decay curves where the measured one is in the calibration range
+double decayCurveError(const std::vector<double> & measured, const std::vector<double> & simulated) {
+	double error = 0;
+	int count = 0;
+	for (size_t i = 0; i < measured.size() && measured[i] >= CALIBRATION_DECAY_END; i++) {
+		if (measured[i] <= CALIBRATION_DECAY_BEGIN) {
+			double difference = measured[i] - (i < simulated.size() ? simulated[i] : -200);
+			error += difference * difference;
+			count++;
+		}
+	}
+	return count > 0 ? sqrt(error / count) : 0;
+}
+
+/*Fits the absorption coefficient so the decay of the traced paths matches the measured impulse response. Every tried
+coefficient reweights the stored paths instead of tracing again: a coarse grid finds the region of the minimum and a golden
+section search refines it. The response of the fitted coefficient is written to output_path.*/
+float calibrateAbsorption(
+	audioPaths * paths,
+	const std::vector<float> & measurement,
+	unsigned int sample_rate,
+	float absorbtion_coef,
+	int max_reflexions,
+	size_t size,
+	const std::string & output_path) {
+
+	auto start = std::chrono::high_resolution_clock::now();
+	//Both responses are compared with one bin per millisecond
+	std::vector<double> measured_energy(measurement.size() * 1000 / sample_rate + 1, 0.0);
+	for (size_t i = 0; i < measurement.size(); i++) {
+		measured_energy[i * 1000 / sample_rate] += measurement[i] * measurement[i];
+	}
+	std::vector<double> measured = decayCurve(measured_energy);
+
+	std::vector<float> rs(measured_energy.size());
+	int evaluations = 0;
+	auto decayError = [&](float coef) {
+		std::fill(rs.begin(), rs.end(), 0.0f);
+		reweightAudioPaths(paths, 1000, 1 - absorbtion_coef, 1 - coef, max_reflexions, &rs);
+		evaluations++;
+		return decayCurveError(measured, decayCurve(std::vector<double>(rs.begin(), rs.end())));
+	};
+
+	float step = 1.0f / CALIBRATION_GRID_STEPS;
+	float best = step / 2;
+	double best_error = decayError(best);
+	for (int g = 1; g < CALIBRATION_GRID_STEPS; g++) {
+		float coef = step / 2 + g * step;
+		double error = decayError(coef);
+		if (error < best_error) {
+			best = coef;
+			best_error = error;
+		}
+	}
+	const float golden = 0.618034f;
+	float low = glm::max(best - step, 0.0f);
+	float high = glm::min(best + step, 1.0f);
+	float x1 = high - golden * (high - low);
+	float x2 = low + golden * (high - low);
+	double e1 = decayError(x1);
+	double e2 = decayError(x2);
+	while (high - low > CALIBRATION_TOLERANCE) {
+		if (e1 < e2) {
+			high = x2;
+			x2 = x1;
+			e2 = e1;
+			x1 = high - golden * (high - low);
+			e1 = decayError(x1);
+		}
+		else {
+			low = x1;
+			x1 = x2;
+			e1 = e2;
+			x2 = low + golden * (high - low);
+			e2 = decayError(x2);
+		}
+	}
+	float fitted = (low + high) / 2;
+	double fitted_error = decayError(fitted);
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << "Calibrated ABSORBTION " << fitted << ": decay curve RMS error " << fitted_error << " dB (" << evaluations
+		<< " evaluations in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+	if (fitted < absorbtion_coef) {
+		std::cout << "The paths were traced with a higher absorption, energy beyond MAX_REFLEXIONS is missing" << std::endl;
+	}
+
+	std::vector<float> calibrated_rs(size, 0.0f);
+	reweightAudioPaths(paths, sample_rate, 1 - absorbtion_coef, 1 - fitted, max_reflexions, &calibrated_rs);
+	std::ofstream calibrated_file(output_path);
+	calibrated_file << std::setprecision(7);
+	float received_energy = 0;
+	for (size_t i = 0; i < size; i++) {
+		calibrated_file << calibrated_rs[i] << ",";
+		received_energy += calibrated_rs[i];
+	}
+	calibrated_file << std::endl << received_energy;
+	calibrated_file.close();
+	return fitted;
+}
+
 void renderAudioFile(
 	Scene * scene, 
 	glm::vec3 listener_pos, 
 	float listener_size,
+	bool adaptive_listener,
 	glm::vec3 source_pos ,
 	float source_power,
 	const char * measurement_file_path,
 	unsigned int measurement_length,
 	int max_reflexions,
 	float absorbtion_coef,
-	int num_rays,
-	timeInterval interval) {
+	long long num_rays,
+	timeInterval interval,
+	ImageSourceTracer * image_sources,
+	BeamTracer * beam_tracer,
+	SpecularPathFinder * specular_paths,
+	PathGuide * path_guide,
+	AcousticRadianceTransfer * late_field,
+	BidirectionalPathTracer * bidirectional,
+	PressureSynthesizer * synthesis,
+	HybridReverb * hybrid_reverb,
+	const std::vector<reweightSetting> & reweights,
+	bool calibrate,
+	unsigned int fine_length,
+	long long seed,
+	unsigned long long config_hash,
+	const checkpointSetting * checkpoint,
+	const shardSetting * shard,
+	const std::string & output_path,
+	int num_threads) {
 
 	audioPaths * paths = new audioPaths();
-	paths->ptr = NULL;
-	paths->size = 0;
-	paths->mutex = new std::mutex;
-
-	RayTracer rt = RayTracer(scene, listener_pos, listener_size, source_pos, source_power, paths, max_reflexions, 1-absorbtion_coef, num_rays);
-
-	rt.OmnidirectionalUniformSphereRayCast();
+	initAudioPaths(paths);
 
 	//The size of Rs will depend on the lenght of the IR I want to mesure and the subdivision of that time length.
 	//This means that if I want an IR to match the Rs used for auralization then I will have to simulate a 1 second IR
@@ -53,6 +271,152 @@ void renderAudioFile(
 		size = sample_rate * round(length);
 	}
 
+	//The paths are only kept when the arrivals in the interval have to be counted or Rs is regenerated for other settings.
+	//Otherwise they are binned directly into Rs.
+	bool stream_paths = interval.end <= interval.begin && reweights.empty() && !calibrate;
+	if (stream_paths) {
+		streamAudioPaths(paths, sample_rate, size, (size_t)fine_length * sample_rate / 1000);
+	}
+
+	if (checkpoint && specular_paths) {
+		//The sequences found by the rays before a crash wouldn't be in the checkpoint
+		std::cout << "Checkpoints are not saved with SPECULAR_PATHS" << std::endl;
+		checkpoint = NULL;
+	}
+
+	//Casts of more rays than an int holds, that can be resumed or that are a shard of a simulation are done in batches
+	//that add up a double histogram. Only the uniform cast of streamed paths can be split like that.
+	bool batched = (checkpoint || shard || num_rays > std::numeric_limits<int>::max()) && stream_paths && !bidirectional && !path_guide;
+	if (shard && !batched) {
+		std::cout << "A shard can only cast the uniform rays of a simulation without ANALYZE, BIDIRECTIONAL or PATH_GUIDING" << std::endl;
+		freeAudioPaths(paths);
+		delete(paths);
+		return;
+	}
+	if (shard && specular_paths) {
+		//The sequences are found by the rays, so each shard would only have its own and they aren't in the partial result
+		std::cout << "A shard can't use SPECULAR_PATHS" << std::endl;
+		freeAudioPaths(paths);
+		delete(paths);
+		return;
+	}
+	if (shard && (late_field || hybrid_reverb || synthesis)) {
+		//They need the whole response, so a shard only has the traced part
+		std::cout << "RADIANCE_TRANSFER, HYBRID_REVERB and SYNTHESIS are not applied to shards" << std::endl;
+		late_field = NULL;
+		hybrid_reverb = NULL;
+		synthesis = NULL;
+	}
+	if (checkpoint && !batched) {
+		std::cout << "Checkpoints are only saved for the uniform ray cast of a simulation without ANALYZE, BIDIRECTIONAL, PATH_GUIDING, reweight or calibrate" << std::endl;
+	}
+	if (num_rays > std::numeric_limits<int>::max() && !batched) {
+		std::cout << "Only " << std::numeric_limits<int>::max() << " rays can be cast without batches" << std::endl;
+	}
+
+	RayTracer rt = RayTracer(scene, listener_pos, listener_size, source_pos, source_power, paths, max_reflexions, 1-absorbtion_coef, (int)std::min(num_rays, (long long)std::numeric_limits<int>::max()));
+
+	rt.adaptive_listener = adaptive_listener;
+	if (num_threads > 0) {
+		rt.num_threads = num_threads;
+	}
+	if (seed >= 0) {
+		rt.seed = seed;
+	}
+	if (shard) {
+		rt.seed = shard->seed;
+	}
+	//The checkpoint is loaded before anything casts rays, so the pilot of the hybrid reverb uses its seed too
+	castCheckpoint state;
+	if (batched) {
+		bool resumed = checkpoint && loadCheckpoint(checkpoint->file_path, &state);
+		unsigned long long first_ray = shard ? glm::min(shard->first_ray, (unsigned long long)num_rays) : 0;
+		unsigned long long end_ray = shard ? glm::min(first_ray + shard->count, (unsigned long long)num_rays) : num_rays;
+		if (resumed && (state.config_hash != config_hash || state.total_rays != num_rays || state.first_ray != first_ray || state.end_ray != end_ray
+			|| (shard && state.seed != shard->seed) || state.sample_rate != sample_rate || state.histogram.size != size
+			|| state.histogram.fine_size != paths->histogram_fine_size)) {
+			std::cout << "The checkpoint " << checkpoint->file_path << " belongs to another simulation, starting over" << std::endl;
+			resumed = false;
+		}
+		if (resumed) {
+			std::cout << "Resuming from ray " << state.next_ray << " of " << state.end_ray << std::endl;
+			rt.seed = state.seed;
+			rt.num_threads = state.num_threads;
+		}
+		else {
+			state.seed = rt.seed;
+			state.config_hash = config_hash;
+			state.total_rays = num_rays;
+			state.first_ray = first_ray;
+			state.end_ray = end_ray;
+			state.next_ray = first_ray;
+			state.num_threads = rt.num_threads;
+			state.sample_rate = sample_rate;
+			state.histogram.resize(size, paths->histogram_fine_size);
+		}
+	}
+
+	if (image_sources) {
+		rt.min_reflexion_order = image_sources->max_order + 1;
+		rt.dynamic_early_reflections = true;
+	}
+	if (beam_tracer) {
+		rt.min_reflexion_order = beam_tracer->max_order + 1;
+	}
+	if (late_field) {
+		rt.max_path_distance = late_field->start_time * SPEED_OF_SOUND;
+	}
+	if (hybrid_reverb) {
+		hybrid_reverb->prepare(&rt);
+	}
+	if (specular_paths) {
+		specular_paths->attach(&rt);
+	}
+
+	if (batched) {
+		clearAudioPaths(paths);
+		castCheckpointed(&rt, &state, checkpoint ? checkpoint->interval : std::numeric_limits<int>::max(), checkpoint ? checkpoint->file_path : "");
+	}
+	else if (bidirectional) {
+		bidirectional->render(&rt);
+	}
+	else if (path_guide) {
+		rt.OmnidirectionalGuidedSphereRayCast(path_guide);
+	}
+	else {
+		rt.OmnidirectionalUniformSphereRayCast();
+	}
+
+	//The paths computed exactly don't depend on the rays, so only the shard that starts at the first ray adds them
+	if (!shard || state.first_ray == 0) {
+		if (image_sources) {
+			image_sources->render(source_pos, listener_pos, paths);
+		}
+		if (beam_tracer) {
+			beam_tracer->render(source_pos, listener_pos, paths);
+		}
+		if (specular_paths) {
+			specular_paths->render(source_pos, listener_pos, paths);
+		}
+	}
+
+	if (shard) {
+		//The partial result is the finished checkpoint of the shard
+		drainAudioHistogram(paths, &state.histogram);
+		if (saveCheckpoint(output_path, state)) {
+			std::cout << "Rays " << state.first_ray << " to " << state.end_ray - 1 << " written to " << output_path << std::endl;
+		}
+		else {
+			std::cout << "Could not write " << output_path << std::endl;
+		}
+		if (checkpoint) {
+			std::remove(checkpoint->file_path.c_str());
+		}
+		freeAudioPaths(paths);
+		delete(paths);
+		return;
+	}
+
 	std::vector<float> * rs = new std::vector<float>(size);
 
 	//Initialize Rs
@@ -62,25 +426,32 @@ void renderAudioFile(
 	std::vector<unsigned int> rays_in_interval(interval_size);
 	std::fill(rays_in_interval.begin(), rays_in_interval.end(), 0);
 
-	//Paths store the distance, to get the corresponding cell in vector Rs we need to find the elapsed time
-	for (int i = 0; i < paths->size; i++) {
-		float distance = paths->ptr[i].travelled_distance;
-		float remaining_factor = paths->ptr[i].remaining_energy_factor;
-		float elapsed_time = distance / SPEED_OF_SOUND;
-		if (elapsed_time * 1000 > interval.begin && elapsed_time * 1000 < interval.end) {
-			rays_in_interval[round((elapsed_time * 1000 - interval.begin) * (sample_rate / 1000))] += 1;
-			//rays_in_interval.push_back(remaining_factor);
-		}
-		//The elapsed time is then converted to a position in the array by multiplying the time by the samples per second
-		//This way a path that takes 1s to reach the listener will ocuppy the last position in the array.
-		unsigned int array_pos = round(elapsed_time * sample_rate);
-		if (array_pos < size && array_pos >= 0) {
-			(*rs)[array_pos] += remaining_factor;
+	if (stream_paths) {
+		reduceAudioHistogram(paths, rs);
+		if (batched) {
+			state.histogram.expand(rs);
 		}
 	}
-	std::ofstream rs_file("rs.txt");
+	else {
+		//Paths store the arrival time, a path that takes 1s to reach the listener will ocuppy the last position in the array.
+		binAudioPaths(paths, sample_rate, rs);
+		forEachAudioPath(paths, [&](const audioPath & path) {
+			float elapsed_time = path.travelled_distance / SPEED_OF_SOUND;
+			if (elapsed_time * 1000 > interval.begin && elapsed_time * 1000 < interval.end) {
+				rays_in_interval[round((elapsed_time * 1000 - interval.begin) * (sample_rate / 1000))] += 1;
+				//rays_in_interval.push_back(remaining_factor);
+			}
+		});
+	}
+	if (late_field) {
+		late_field->render(source_pos, listener_pos, rs, sample_rate);
+	}
+	if (hybrid_reverb) {
+		hybrid_reverb->render(rs, sample_rate);
+	}
+	std::ofstream rs_file(output_path);
 	rs_file << std::setprecision(7);
-	float received_energy = 0;
+	double received_energy = 0;
 	for (int i = 0; i < size; i++) {
 		rs_file << (*rs)[i] << ",";
 		received_energy += (*rs)[i];
@@ -93,12 +464,12 @@ void renderAudioFile(
 
 	rs_file << std::endl;
 	int direct_paths = 0;
-	for (int i = 0; i < paths->size; i++) {
-		if (paths->ptr[i].is_direct_path) {
+	forEachAudioPath(paths, [&](const audioPath & path) {
+		if (path.is_direct_path) {
 			direct_paths++;
-			rs_file << paths->ptr[i].remaining_energy_factor << ",";
+			rs_file << path.remaining_energy_factor << ",";
 		}
-	}
+	});
 
 	rs_file << std::endl;
 	for (int i = 0; i < rays_in_interval.size(); i++) {
@@ -106,4 +477,59 @@ void renderAudioFile(
 	}
 
 	rs_file.close();
+	if (batched && checkpoint) {
+		//The response is written, so running the simulation again starts over
+		std::remove(checkpoint->file_path.c_str());
+	}
+
+	if (synthesis) {
+		std::vector<float> pressure;
+		synthesis->synthesize(*rs, sample_rate, &pressure);
+		double energy_difference = pressureEnergyDifference(*rs, pressure);
+		if (fabs(energy_difference) > SYNTHESIS_ENERGY_TOLERANCE) {
+			std::cout << "The pressure response has " << energy_difference << " dB of the energy of Rs" << std::endl;
+		}
+		std::ofstream pressure_file(output_path.substr(0, output_path.rfind(".txt")) + "_pressure.txt");
+		pressure_file << std::setprecision(7);
+		for (size_t i = 0; i < pressure.size(); i++) {
+			pressure_file << pressure[i] << ",";
+		}
+		pressure_file.close();
+	}
+
+	//Each setting reuses the traced paths, so only the binning is repeated
+	if ((!reweights.empty() || calibrate) && (late_field || hybrid_reverb)) {
+		std::cout << "The late field is not included in the reweighted responses" << std::endl;
+	}
+	for (size_t r = 0; r < reweights.size(); r++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::fill(rs->begin(), rs->end(), 0.0f);
+		reweightAudioPaths(paths, sample_rate, 1 - absorbtion_coef, 1 - reweights[r].absorbtion_coef, reweights[r].max_reflexions, rs);
+		auto end = std::chrono::high_resolution_clock::now();
+		if (reweights[r].max_reflexions > max_reflexions) {
+			std::cout << "Only paths of up to " << max_reflexions << " reflexions were traced" << std::endl;
+		}
+
+		std::ostringstream reweight_file_path;
+		//rs.txt -> rs_[absorbtion]_[max reflexions].txt
+		reweight_file_path << output_path.substr(0, output_path.rfind(".txt")) << "_" << reweights[r].absorbtion_coef << "_" << reweights[r].max_reflexions << ".txt";
+		std::ofstream reweight_file(reweight_file_path.str());
+		reweight_file << std::setprecision(7);
+		float reweighted_energy = 0;
+		for (int i = 0; i < size; i++) {
+			reweight_file << (*rs)[i] << ",";
+			reweighted_energy += (*rs)[i];
+		}
+		reweight_file << std::endl << reweighted_energy;
+		reweight_file.close();
+		std::cout << "ABSORBTION " << reweights[r].absorbtion_coef << ", MAX_REFLEXIONS " << reweights[r].max_reflexions << ": "
+			<< reweight_file_path.str() << " (" << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+	}
+	if (calibrate) {
+		calibrateAbsorption(paths, measurement_file.samples[0], sample_rate, absorbtion_coef, max_reflexions, size,
+			output_path.substr(0, output_path.rfind(".txt")) + "_calibrated.txt");
+	}
+	delete(rs);
+	freeAudioPaths(paths);
+	delete(paths);
 }
\ No newline at end of file
@@ -136,6 +136,16 @@ AudioRenderer::AudioRenderer(int max_reflexions, float absorbtion_coef, int num_
 	this->source_power = source_power;
 	this->listener_size = listener_size;
 	this->sample_rate = sample_rate;
+	this->image_sources = NULL;
+	this->beam_tracer = NULL;
+	this->adaptive_listener = false;
+	this->fine_length = 0;
+	this->specular_paths = NULL;
+	this->path_guide = NULL;
+	this->late_field = NULL;
+	this->bidirectional = NULL;
+	this->synthesis = NULL;
+	this->hybrid_reverb = NULL;
 
 	//Init audio stream
 	this->audioApi = new RtAudio();
@@ -171,9 +181,7 @@ AudioRenderer::AudioRenderer(int max_reflexions, float absorbtion_coef, int num_
 	this->audioData->samplesRecordBufferSize = this->sample_rate * input_channles;
 	this->audioData->samplesRecordBuffer = new CircularBuffer<SAMPLE_TYPE>(this->audioData->samplesRecordBufferSize);
 	this->audioData->paths = new audioPaths();
-	this->audioData->paths->ptr = NULL;
-	this->audioData->paths->size = 0;
-	this->audioData->paths->mutex = new std::mutex();
+	initAudioPaths(this->audioData->paths);
 	this->audioData->volume = 30.0f;
 	//this->audioData->pool = new thread_pool(4);
 
@@ -195,9 +203,7 @@ AudioRenderer::AudioRenderer(int max_reflexions, float absorbtion_coef, int num_
 	}
 
 	this->currentPaths = new audioPaths();
-	this->currentPaths->ptr = NULL;
-	this->currentPaths->size = 0;
-	this->currentPaths->mutex = new std::mutex;
+	initAudioPaths(this->currentPaths);
 
 	//Create Rs vector
 	this->audioData->Rs = new std::vector<float>(this->audioData->samplesRecordBufferSize);
@@ -211,6 +217,16 @@ AudioRenderer::AudioRenderer(int max_reflexions, float absorbtion_coef, int num_
 	this->source_power = source_power;
 	this->listener_size = listener_size;
 	this->sample_rate = sample_rate;
+	this->image_sources = NULL;
+	this->beam_tracer = NULL;
+	this->adaptive_listener = false;
+	this->fine_length = 0;
+	this->specular_paths = NULL;
+	this->path_guide = NULL;
+	this->late_field = NULL;
+	this->bidirectional = NULL;
+	this->synthesis = NULL;
+	this->hybrid_reverb = NULL;
 
 	//Init audio stream
 	this->audioApi = new RtAudio();
@@ -245,15 +261,11 @@ AudioRenderer::AudioRenderer(int max_reflexions, float absorbtion_coef, int num_
 	this->audioData->samplesRecordBufferSize = (audio_length + 1) * this->sample_rate;
 	this->audioData->samplesRecordBuffer = new CircularBuffer<SAMPLE_TYPE>(this->audioData->samplesRecordBufferSize);
 	this->audioData->paths = new audioPaths();
-	this->audioData->paths->ptr = NULL;
-	this->audioData->paths->size = 0;
-	this->audioData->paths->mutex = new std::mutex();
+	initAudioPaths(this->audioData->paths);
 	this->audioData->volume = 30.0f;
 
 	this->currentPaths = new audioPaths();
-	this->currentPaths->ptr = NULL;
-	this->currentPaths->size = 0;
-	this->currentPaths->mutex = new std::mutex;
+	initAudioPaths(this->currentPaths);
 
 	//Create Rs vector
 	this->audioData->Rs = new std::vector<float>(this->sample_rate);
@@ -295,23 +307,65 @@ void AudioRenderer::resetStream() {
 }
 
 void AudioRenderer::render(Scene * scene, Camera * camera, Source * source) {
+	//Only Rs is needed, so the paths are binned as they are found instead of stored
+	streamAudioPaths(this->currentPaths, this->sample_rate, this->audioData->Rs->size(), (size_t)this->fine_length * this->sample_rate / 1000);
 	RayTracer rt = RayTracer(scene, camera->pos, this->listener_size, source->pos, this->source_power, this->currentPaths, this->max_reflexions, 1-(this->absorbtion_coef), this->num_rays);
-	rt.OmnidirectionalUniformSphereRayCast();
+	rt.adaptive_listener = this->adaptive_listener;
+	if (this->image_sources) {
+		rt.min_reflexion_order = this->image_sources->max_order + 1;
+		rt.dynamic_early_reflections = true;
+	}
+	if (this->beam_tracer) {
+		rt.min_reflexion_order = this->beam_tracer->max_order + 1;
+	}
+	if (this->late_field) {
+		rt.max_path_distance = this->late_field->start_time * SPEED_OF_SOUND;
+	}
+	if (this->hybrid_reverb) {
+		//The pilot is only cast again when the static geometry changes
+		this->hybrid_reverb->prepare(&rt);
+	}
+	if (this->specular_paths) {
+		//The sequences found in previous renders are kept, the ray tracer only has to find the missing ones
+		this->specular_paths->attach(&rt);
+	}
+	if (this->bidirectional) {
+		this->bidirectional->render(&rt);
+	}
+	else if (this->path_guide) {
+		rt.OmnidirectionalGuidedSphereRayCast(this->path_guide);
+	}
+	else {
+		rt.OmnidirectionalUniformSphereRayCast();
+	}
+	if (this->image_sources) {
+		//Image source tree is cached, so if only the listener moved this just revalidates the paths
+		this->image_sources->render(source->pos, camera->pos, this->currentPaths);
+	}
+	if (this->beam_tracer) {
+		this->beam_tracer->render(source->pos, camera->pos, this->currentPaths);
+	}
+	if (this->specular_paths) {
+		this->specular_paths->render(source->pos, camera->pos, this->currentPaths);
+	}
 	
 	//Initialize Rs
 	std::fill(this->audioData->Rs->begin(), this->audioData->Rs->end(), 0.0);
 
-	//Paths store the distance, to get the corresponding cell in vector Rs we need to find the elapsed time
-	for (int i = 0; i < this->currentPaths->size; i++) {
-		float distance = this->currentPaths->ptr[i].travelled_distance;
-		float remaining_factor = this->currentPaths->ptr[i].remaining_energy_factor;
-		float elapsed_time = distance / SPEED_OF_SOUND;
-		//The elapsed time is then converted to a position in the array by multiplying the time by the samples per second
-		//This way a path that takes 1s to reach the listener will ocuppy the last position in the array.
-		unsigned int array_pos = round(elapsed_time * this->sample_rate);
-		if (array_pos < this->audioData->samplesRecordBufferSize && array_pos >= 0) {
-			(*this->audioData->Rs)[array_pos] += remaining_factor;
-		}
+	//Each tracing thread binned its paths by arrival time (a path that takes 1s to reach the listener ocuppies the
+	//last position in the array), so Rs is the sum of their histograms
+	reduceAudioHistogram(this->currentPaths, this->audioData->Rs);
+	if (this->late_field) {
+		//Propagation is cached by source position, so if only the listener moved this just gathers the patches
+		this->late_field->render(source->pos, camera->pos, this->audioData->Rs, this->sample_rate);
+	}
+	if (this->hybrid_reverb) {
+		this->hybrid_reverb->render(this->audioData->Rs, this->sample_rate);
+	}
+	if (this->synthesis) {
+		std::vector<float> pressure;
+		this->synthesis->synthesize(*this->audioData->Rs, this->sample_rate, &pressure);
+		std::copy(pressure.begin(), pressure.end(), this->audioData->Rs->begin());
 	}
 	//std::ofstream rs_file("rs.txt");
 	//rs_file << std::setprecision(7);
@@ -13,6 +13,13 @@ contiguous samples are 1/44100 seconds apart.*/
 #include "Camera.h"
 #include "Source.h"
 #include "CircularBuffer.h"
+#include "ImageSource.h"
+#include "SpecularPathFinder.h"
+#include "BeamTracer.h"
+#include "RadianceTransfer.h"
+#include "BidirectionalPathTracer.h"
+#include "PressureSynthesizer.h"
+#include "HybridReverb.h"
 //#include "thread_pool.hpp"
 
 #include<random>
@@ -58,8 +65,27 @@ public:
 	int num_rays;
 	float source_power;
 	float listener_size;
+	bool adaptive_listener;
+	//Milliseconds of Rs with a bin per sample. Later bins get progressively coarser (see TimeHistogram). 0 for all fine.
+	unsigned int fine_length;
 	int sample_rate;
 	AudioFile<float> audio_sample_file;
+	//Optional. If set the early reflections are computed with image sources and the ray tracer only computes the rest.
+	ImageSourceTracer * image_sources;
+	//Optional. Alternative to image_sources, the early reflections are computed with beam tracing.
+	BeamTracer * beam_tracer;
+	//Optional. If set the early paths found by the ray tracer are replaced by their exact specular path.
+	SpecularPathFinder * specular_paths;
+	//Optional. If set the ray directions are learned and sampled from the guide instead of uniformly.
+	PathGuide * path_guide;
+	//Optional. If set the ray tracer stops at late_field->start_time and the rest of the response is computed with radiance transfer.
+	AcousticRadianceTransfer * late_field;
+	//Optional. If set it replaces the ray cast (and the path guide) with bidirectional path tracing.
+	BidirectionalPathTracer * bidirectional;
+	//Optional. If set Rs is turned into a synthesized pressure response before it is convolved.
+	PressureSynthesizer * synthesis;
+	//Optional. If set the ray tracer stops at the mixing time of the room and the rest of the response is a fitted decay.
+	HybridReverb * hybrid_reverb;
 
 public:
 	AudioRenderer(){};
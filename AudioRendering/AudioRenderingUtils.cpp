@@ -4,10 +4,13 @@
 #include<cmath>
 #include<chrono>
 #include <vector>
+#include <algorithm>
+#include <new>
 #include "Halton.h"
 #include "halton_sampler.h"
 #include <ctime>
 #include <iostream>
+#include <atomic>
 
 RayTracer::RayTracer(Scene * scene,
 	glm::vec3 listener_pos,
@@ -21,20 +24,285 @@ RayTracer::RayTracer(Scene * scene,
 	this->scene = scene;
 	this->listener_pos = listener_pos;
 	this->listener_size = listener_size;
+	this->adaptive_listener = false;
 	this->source_pos = source_pos;
 	this->source_power = source_power;
 	this->paths = paths;
 	this->max_reflexions = max_reflexions;
 	this->reflexion_coef = reflexion_coef;
 	this->num_rays = num_rays;
+	this->min_reflexion_order = 0;
+	this->dynamic_early_reflections = false;
+	this->max_path_distance = std::numeric_limits<float>::infinity();
+	this->specular_order = -1;
+	this->specular_sequences = NULL;
+	this->specular_discovery_rays = std::numeric_limits<int>::max();
+	this->num_threads = glm::max(1, (int)std::thread::hardware_concurrency());
+	this->seed = std::chrono::system_clock::now().time_since_epoch().count();
 }
 
-intersectionData RayTracer::raySphereIntersection(glm::vec3 origin, glm::vec3 dir, glm::vec3 center) {
+static std::atomic<unsigned long long> next_paths_id(1);
+//Arena of the last paths this thread added to
+static thread_local unsigned long long cached_paths_id = 0;
+static thread_local unsigned int cached_paths_generation = 0;
+static thread_local audioPathArena * cached_arena = NULL;
+
+void initAudioPaths(audioPaths * paths) {
+	paths->arenas.clear();
+	paths->mutex = new std::mutex();
+	paths->id = next_paths_id++;
+	paths->generation = 0;
+	paths->histogram_sample_rate = 0;
+	paths->histogram_size = 0;
+	paths->histogram_fine_size = 0;
+}
+
+static audioPathArena * threadArena(audioPaths * paths) {
+	if (cached_paths_id == paths->id && cached_paths_generation == paths->generation) {
+		return cached_arena;
+	}
+	std::thread::id self = std::this_thread::get_id();
+	audioPathArena * arena = NULL;
+	paths->mutex->lock();
+	for (size_t a = 0; a < paths->arenas.size() && !arena; a++) {
+		if (paths->arenas[a]->owner == self) {
+			arena = paths->arenas[a];
+		}
+	}
+	//Arenas of threads from previous renders are reused
+	for (size_t a = 0; a < paths->arenas.size() && !arena; a++) {
+		if (paths->arenas[a]->owner == std::thread::id()) {
+			arena = paths->arenas[a];
+			arena->owner = self;
+		}
+	}
+	if (!arena) {
+		arena = new audioPathArena();
+		arena->owner = self;
+		arena->current = 0;
+		paths->arenas.push_back(arena);
+	}
+	if (arena->histogram.size != paths->histogram_size) {
+		arena->histogram.resize(paths->histogram_size, paths->histogram_fine_size);
+	}
+	paths->mutex->unlock();
+	cached_paths_id = paths->id;
+	cached_paths_generation = paths->generation;
+	cached_arena = arena;
+	return arena;
+}
+
+static void appendAudioPath(audioPathArena * arena, const audioPath & path) {
+	if (arena->chunks.empty() || arena->chunks[arena->current].size == arena->chunks[arena->current].capacity) {
+		if (!arena->chunks.empty()) {
+			arena->current++;
+		}
+		if (arena->current == arena->chunks.size()) {
+			size_t capacity = arena->chunks.empty() ? AUDIO_PATHS_FIRST_CHUNK : arena->chunks.back().capacity * 2;
+			audioPathChunk chunk;
+			chunk.arrival = (unsigned int*)malloc(capacity * (sizeof(unsigned int) + sizeof(float) + sizeof(unsigned char)));
+			if (!chunk.arrival) {
+				throw std::bad_alloc();
+			}
+			chunk.energy = (float*)(chunk.arrival + capacity);
+			chunk.order = (unsigned char*)(chunk.energy + capacity);
+			chunk.size = 0;
+			chunk.capacity = capacity;
+			arena->chunks.push_back(chunk);
+		}
+	}
+	audioPathChunk * chunk = &arena->chunks[arena->current];
+	double ticks = glm::round((double)path.travelled_distance / SPEED_OF_SOUND * AUDIO_PATH_TICKS_PER_SECOND);
+	chunk->arrival[chunk->size] = (unsigned int)glm::clamp(ticks, 0.0, (double)std::numeric_limits<unsigned int>::max());
+	chunk->energy[chunk->size] = path.remaining_energy_factor;
+	chunk->order[chunk->size] = (unsigned char)glm::clamp(path.reflection_order, 0, AUDIO_PATH_MAX_ORDER) | (path.is_direct_path ? AUDIO_PATH_DIRECT : 0);
+	chunk->size++;
+}
+
+static void addToArena(audioPaths * paths, audioPathArena * arena, const audioPath & path) {
+	if (paths->histogram_size) {
+		arena->histogram.add((size_t)round(path.travelled_distance / SPEED_OF_SOUND * paths->histogram_sample_rate), path.remaining_energy_factor);
+		if (!path.is_direct_path) {
+			return;
+		}
+	}
+	appendAudioPath(arena, path);
+}
+
+void addAudioPath(audioPaths * paths, audioPath path) {
+	addToArena(paths, threadArena(paths), path);
+}
+
+void addAudioPaths(audioPaths * paths, const std::vector<audioPath> & new_paths) {
+	if (new_paths.empty()) {
+		return;
+	}
+	audioPathArena * arena = threadArena(paths);
+	for (size_t i = 0; i < new_paths.size(); i++) {
+		addToArena(paths, arena, new_paths[i]);
+	}
+}
+
+size_t audioPathCount(audioPaths * paths) {
+	size_t count = 0;
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		for (size_t c = 0; c < paths->arenas[a]->chunks.size(); c++) {
+			count += paths->arenas[a]->chunks[c].size;
+		}
+	}
+	return count;
+}
+
+void clearAudioPaths(audioPaths * paths) {
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		audioPathArena * arena = paths->arenas[a];
+		for (size_t c = 0; c < arena->chunks.size(); c++) {
+			arena->chunks[c].size = 0;
+		}
+		arena->current = 0;
+		arena->owner = std::thread::id();
+		arena->histogram.resize(paths->histogram_size, paths->histogram_fine_size);
+	}
+	//Invalidates the arenas cached by the threads
+	paths->generation++;
+}
+
+void releaseAudioArenas(audioPaths * paths) {
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		paths->arenas[a]->owner = std::thread::id();
+	}
+	//Invalidates the arenas cached by the threads
+	paths->generation++;
+}
+
+void freeAudioPaths(audioPaths * paths) {
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		for (size_t c = 0; c < paths->arenas[a]->chunks.size(); c++) {
+			free(paths->arenas[a]->chunks[c].arrival);
+		}
+		delete(paths->arenas[a]);
+	}
+	paths->arenas.clear();
+	delete(paths->mutex);
+	paths->mutex = NULL;
+}
+
+void streamAudioPaths(audioPaths * paths, unsigned int sample_rate, size_t size, size_t fine_size) {
+	if (paths->histogram_sample_rate != sample_rate || paths->histogram_size != size || paths->histogram_fine_size != fine_size) {
+		paths->histogram_sample_rate = sample_rate;
+		paths->histogram_size = size;
+		paths->histogram_fine_size = fine_size;
+		clearAudioPaths(paths);
+	}
+}
+
+/*Adds the histograms of the arenas to total bin by bin. The threads take the arenas in any order, so the values of each
+bin are sorted before adding them: the same paths always give the same bits.*/
+static void sumAudioHistograms(audioPaths * paths, TimeHistogram * total) {
+	std::vector<double> values(paths->arenas.size());
+	for (size_t i = 0; i < total->bins.size(); i++) {
+		for (size_t a = 0; a < paths->arenas.size(); a++) {
+			values[a] = i < paths->arenas[a]->histogram.bins.size() ? paths->arenas[a]->histogram.bins[i] : 0.0;
+		}
+		std::sort(values.begin(), values.end());
+		for (size_t a = 0; a < values.size(); a++) {
+			total->bins[i] += values[a];
+		}
+	}
+}
+
+void reduceAudioHistogram(audioPaths * paths, std::vector<float> * rs) {
+	if (paths->arenas.empty()) {
+		return;
+	}
+	//The histograms share the layout, so they are added bin by bin and only the sum is expanded
+	TimeHistogram total;
+	total.resize(paths->histogram_size, paths->histogram_fine_size);
+	sumAudioHistograms(paths, &total);
+	total.expand(rs);
+}
+
+void drainAudioHistogram(audioPaths * paths, TimeHistogram * total) {
+	sumAudioHistograms(paths, total);
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		paths->arenas[a]->histogram.clear();
+	}
+	releaseAudioArenas(paths);
+}
+
+//Bins the paths into rs scaling each energy by the factor of its reflection order, or 1 if order_factors is NULL
+static void binAudioPaths(audioPaths * paths, unsigned int sample_rate, const float * order_factors, std::vector<float> * rs) {
+	//Bins are computed for a block of paths at a time, a loop the compiler can vectorize, and then added to rs
+	const size_t block = 256;
+	unsigned int bins[block];
+	double scale = (double)sample_rate / AUDIO_PATH_TICKS_PER_SECOND;
+	size_t size = rs->size();
+	float * rs_ptr = rs->data();
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		const std::vector<audioPathChunk> & chunks = paths->arenas[a]->chunks;
+		for (size_t c = 0; c < chunks.size(); c++) {
+			const unsigned int * arrival = chunks[c].arrival;
+			const float * energy = chunks[c].energy;
+			const unsigned char * order = chunks[c].order;
+			for (size_t begin = 0; begin < chunks[c].size; begin += block) {
+				size_t count = glm::min(block, chunks[c].size - begin);
+				for (size_t i = 0; i < count; i++) {
+					bins[i] = (unsigned int)(arrival[begin + i] * scale + 0.5);
+				}
+				if (order_factors) {
+					for (size_t i = 0; i < count; i++) {
+						if (bins[i] < size) {
+							rs_ptr[bins[i]] += energy[begin + i] * order_factors[order[begin + i] & AUDIO_PATH_MAX_ORDER];
+						}
+					}
+				}
+				else {
+					for (size_t i = 0; i < count; i++) {
+						if (bins[i] < size) {
+							rs_ptr[bins[i]] += energy[begin + i];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void binAudioPaths(audioPaths * paths, unsigned int sample_rate, std::vector<float> * rs) {
+	binAudioPaths(paths, sample_rate, NULL, rs);
+}
+
+void reweightAudioPaths(audioPaths * paths, unsigned int sample_rate, float traced_reflexion_coef, float reflexion_coef, int max_reflexions, std::vector<float> * rs) {
+	//If nothing was reflected in the trace there is no energy left to scale
+	float ratio = traced_reflexion_coef > 0 ? reflexion_coef / traced_reflexion_coef : 0;
+	float order_factors[AUDIO_PATH_MAX_ORDER + 1];
+	order_factors[0] = 1;
+	for (int order = 1; order <= AUDIO_PATH_MAX_ORDER; order++) {
+		//castRay still reflects a ray that has max_reflexions reflections, so it finds paths of up to max_reflexions + 1
+		order_factors[order] = order <= max_reflexions + 1 ? order_factors[order - 1] * ratio : 0;
+	}
+	binAudioPaths(paths, sample_rate, order_factors, rs);
+}
+
+void RayTracer::castInParallel(int first_ray, int count, const std::function<void(int, int, int)> & cast) {
+	int threads_used = glm::clamp(this->num_threads, 1, glm::max(count, 1));
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threads_used; t++) {
+		int begin = first_ray + (int)((long long)count * t / threads_used);
+		int end = first_ray + (int)((long long)count * (t + 1) / threads_used);
+		threads.push_back(std::thread(cast, t, begin, end));
+	}
+	for (int t = 0; t < threads_used; t++) {
+		threads[t].join();
+	}
+}
+
+intersectionData RayTracer::raySphereIntersection(glm::vec3 origin, glm::vec3 dir, glm::vec3 center, float radius) {
 	//The following is obtained from solving the ecuation system given by the ray and sphere
 	//The result is a second degree ecuation: at^2 + bt + c = 0
 	float a = glm::dot(dir, dir);
 	float b = 2 * glm::dot(dir, origin - center);
-	float c = glm::dot(origin - center, origin - center) - pow(this->listener_size, 2);
+	float c = glm::dot(origin - center, origin - center) - pow(radius, 2);
 	float discriminant = (pow(b, 2) - 4 * a*c);
 	if (discriminant < 0) {
 		return { -1, 0 };
@@ -49,12 +317,37 @@ intersectionData RayTracer::raySphereIntersection(glm::vec3 origin, glm::vec3 di
 				return { t2, t1 - t2 };
 			}
 		}
+		//Ray starts inside the sphere. Only the part in front of the origin counts.
+		if (t1 <= 0 && t2 > 0) {
+			return { 0, t2 };
+		}
 		return { -1, 0 };
 	}
 }
 
-float RayTracer::rayIntensity(float remaining_energy, float distance_inside_sphere) {
-	return distance_inside_sphere * remaining_energy / ((4 / 3) * M_PI * pow(this->listener_size, 3));
+void RayTracer::addSpecularSequence(reflectorSequence * sequence) {
+	this->specular_sequences->mutex.lock();
+	this->specular_sequences->set.insert(*sequence);
+	this->specular_sequences->mutex.unlock();
+}
+
+float RayTracer::rayIntensity(float remaining_energy, float distance_inside_sphere, float radius) {
+	//The energy is normalized by the volume of the sphere that was actually tested, so the expected value of a path
+	//(energy / (4 pi d^2)) doesn't depend on the radius.
+	return distance_inside_sphere * remaining_energy / ((4.0f / 3.0f) * M_PI * pow(radius, 3));
+}
+
+float RayTracer::listenerRadius(float path_distance) {
+	if (!this->adaptive_listener) {
+		return this->listener_size;
+	}
+	//Each ray represents a solid angle of 4pi / num_rays. At distance d its footprint has an area of 4pi d^2 / num_rays,
+	//the radius is chosen so the listener's cross section matches it.
+	return glm::max(this->listener_size, path_distance * sqrtf(4.0f / this->num_rays));
+}
+
+bool RayTracer::isStoredOrder(const rayHistory & history) {
+	return history.reflection_num >= this->min_reflexion_order || history.dynamic_reflection;
 }
 
 /*
@@ -62,7 +355,7 @@ float RayTracer::rayIntensity(float remaining_energy, float distance_inside_sphe
  * (dx, dy, dz).
  */
  //This function needs to do the intersection with the sound source and the reflection of the ray if it collides with geometry
-void RayTracer::castRay(
+float RayTracer::castRay(
 	glm::vec3 origin,
 	glm::vec3 dir,
 	rayHistory history)
@@ -95,8 +388,10 @@ void RayTracer::castRay(
 
 	rtcIntersect1(this->scene->getRTCScene(), &context, &rayhit);
 
-	//Check if ray interescts listener
-	intersectionData intersection_data = raySphereIntersection(origin, dir, listener_pos);
+	//Check if ray interescts listener. The radius is evaluated at the point of the ray closest to the listener.
+	float closest_distance = glm::max(glm::dot(listener_pos - origin, glm::normalize(dir)), 0.0f);
+	float listener_radius = listenerRadius(history.travelled_distance + closest_distance);
+	intersectionData intersection_data = raySphereIntersection(origin, dir, listener_pos, listener_radius);
 	//Check if ray intersects room
 	if (rayhit.hit.geomID != RTC_INVALID_GEOMETRY_ID)
 	{
@@ -109,13 +404,20 @@ void RayTracer::castRay(
 				//Return parameters and traveled distance to add to the histogram
 				//printf("Found intersection with listener. %i\n", history.reflection_num);
 				//Add path to paths
-				audioPath newAudioPath = { history.travelled_distance + intersection_data.distance_to_sphere, rayIntensity(history.remaining_energy_factor, intersection_data.distance_inside_sphere), history.reflection_num == 0 };
-				this->paths->mutex->lock();
-				this->paths->size++;
-				this->paths->ptr = (audioPath*)realloc(paths->ptr, paths->size * sizeof(audioPath));
-				this->paths->ptr[paths->size - 1] = newAudioPath;
-				this->paths->mutex->unlock();
-				return;
+				float intensity = rayIntensity(history.remaining_energy_factor, intersection_data.distance_inside_sphere, listener_radius);
+				float path_distance = history.travelled_distance + intersection_data.distance_to_sphere;
+				if (isStoredOrder(history) && path_distance <= this->max_path_distance) {
+					if (this->specular_sequences && history.reflection_num <= this->specular_order) {
+						if (history.reflectors) {
+							addSpecularSequence(history.reflectors);
+						}
+					}
+					else {
+						audioPath newAudioPath = { path_distance, intensity, history.reflection_num == 0, history.reflection_num };
+						addAudioPath(this->paths, newAudioPath);
+					}
+				}
+				return intensity;
 			}
 			else {
 				//printf("Intersection blocked by geometry. %i\n", history.reflection_num);
@@ -125,11 +427,14 @@ void RayTracer::castRay(
 		//Calculate remaining energy if less than something also return
 		if (history.reflection_num > this->max_reflexions) {
 			//printf("Ray exahusted.\n");
-			return;
+			return 0;
+		}
+		if (history.travelled_distance + rayhit.ray.tfar > this->max_path_distance) {
+			return 0;
 		}
 		//Reflect ray with geometry normal
 		glm::vec3 new_dir;
-		glm::vec3 normal = glm::normalize(glm::vec3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z));
+		glm::vec3 normal = this->scene->hitNormal(rayhit.hit);
 		if (glm::dot(dir, normal) < 0) {
 			new_dir = glm::reflect(dir, normal);
 		}
@@ -138,12 +443,18 @@ void RayTracer::castRay(
 		}
 		//New origin is obtained by moving tfar in the ray direction from the current origin
 		glm::vec3 new_origin = origin + dir * rayhit.ray.tfar;
+		if (history.reflectors && history.reflection_num < this->specular_order) {
+			history.reflectors->push_back({ this->scene->hitObject(rayhit.hit), rayhit.hit.primID });
+		}
+		if (this->dynamic_early_reflections && this->scene->isDynamic(this->scene->hitObject(rayhit.hit))) {
+			history.dynamic_reflection = true;
+		}
 		//When casting new ray new origin must me moved delta in the new direction to avoid numeric errors. (Ray begining inside the geometry)
 		history.reflection_num++;
 		history.remaining_energy_factor *= reflexion_coef;
 		history.travelled_distance += rayhit.ray.tfar;
 		//if (history.remaining_energy_factor > 0.0000000001) {
-			castRay(new_origin + new_dir * 0.01f, new_dir, history);
+			return castRay(new_origin + new_dir * 0.01f, new_dir, history);
 		//}
 
 		/* Note how geomID and primID identify the geometry we just hit.
@@ -156,42 +467,31 @@ void RayTracer::castRay(
 			//Calculate parameters for transfer function (e.g. absorption from specular reflections)
 			//Return parameters and traveled distance to add to the histogram
 			//printf("Found intersection with listener. %i\n", history.reflection_num);
-			audioPath newAudioPath = { history.travelled_distance + intersection_data.distance_to_sphere, rayIntensity(history.remaining_energy_factor, intersection_data.distance_inside_sphere), history.reflection_num == 0 };
-			this->paths->mutex->lock();
-			this->paths->size++;
-			this->paths->ptr = (audioPath*)realloc(paths->ptr, paths->size * sizeof(audioPath));
-			this->paths->ptr[paths->size - 1] = newAudioPath;
-			this->paths->mutex->unlock();
-			return;
+			float intensity = rayIntensity(history.remaining_energy_factor, intersection_data.distance_inside_sphere, listener_radius);
+			float path_distance = history.travelled_distance + intersection_data.distance_to_sphere;
+			if (isStoredOrder(history) && path_distance <= this->max_path_distance) {
+				if (this->specular_sequences && history.reflection_num <= this->specular_order) {
+					if (history.reflectors) {
+						addSpecularSequence(history.reflectors);
+					}
+				}
+				else {
+					audioPath newAudioPath = { path_distance, intensity, history.reflection_num == 0, history.reflection_num };
+					addAudioPath(this->paths, newAudioPath);
+				}
+			}
+			return intensity;
 		}
 	}
 	//printf("No intersection with listener found.\n");
-	return;
+	return 0;
 }
 
 void RayTracer::OmnidirectionalUniformSphereRayCast()
 {
 	//If we are rendering audio again then we celar previously found paths
-	if (this->paths->ptr) {
-		free(this->paths->ptr);
-		this->paths->ptr = NULL;
-		this->paths->size = 0;
-	}
-
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::mt19937 generator(seed);
-	std::uniform_real_distribution<double> uniform01(0.0, 1.0);
-
-	for (int i = 0; i < this->num_rays; ++i) {
-		double theta = 2 * M_PI * uniform01(generator);
-		double phi = acos(1 - 2 * uniform01(generator));
-		double dx = sin(phi) * cos(theta);
-		double dy = sin(phi) * sin(theta);
-		double dz = cos(phi);
-		glm::vec3 dir = glm::normalize(glm::vec3(dx, dy, dz));
-		rayHistory new_ray_history = { 0.0f, this->source_power / this->num_rays, 0 };
-		castRay(source_pos, dir, new_ray_history);
-	}
+	clearAudioPaths(this->paths);
+	UniformSphereRayRange(0, this->num_rays, this->num_rays);
 
 	////srand(time(NULL));
 	//float rnd1 = uniform01(generator);
@@ -209,36 +509,89 @@ void RayTracer::OmnidirectionalUniformSphereRayCast()
 	//}
 }
 
+void RayTracer::UniformSphereRayRange(unsigned long long first_ray, int count, unsigned long long total_rays)
+{
+	castInParallel(0, count, [&](int thread, int begin, int end) {
+		//Every thread has its own buffer for the reflectors hit by the current ray
+		reflectorSequence sequence;
+		for (int i = begin; i < end; ++i) {
+			unsigned long long ray = first_ray + i;
+			double theta = 2 * M_PI * rayRandom(this->seed, ray, 0);
+			double phi = acos(1 - 2 * rayRandom(this->seed, ray, 1));
+			double dx = sin(phi) * cos(theta);
+			double dy = sin(phi) * sin(theta);
+			double dz = cos(phi);
+			glm::vec3 dir = glm::normalize(glm::vec3(dx, dy, dz));
+			sequence.clear();
+			rayHistory new_ray_history = { 0.0f, (float)(this->source_power / (double)total_rays), 0, this->specular_sequences && ray < (unsigned long long)this->specular_discovery_rays ? &sequence : NULL, false };
+			castRay(source_pos, dir, new_ray_history);
+		}
+	});
+}
+
 void RayTracer::OmnidirectionalHaltonSphereRayCast()
 {
 	//If we are rendering audio again then we celar previously found paths
-	if (this->paths->ptr) {
-		free(this->paths->ptr);
-		this->paths->ptr = NULL;
-		this->paths->size = 0;
-	}
-
+	clearAudioPaths(this->paths);
 	//Halton_sampler sampler = Halton_sampler();
 	//sampler.init_faure();
 
-	for (int i = 0; i < this->num_rays; ++i) {
-		double* phitheta = halton(i, 2);
-		/*float halton_x = sampler.sample(2, i);
-		float halton_y = sampler.sample(3, i);*/
-		double theta = 2 * M_PI * phitheta[1];
-		double phi = acos(1 - 2 * phitheta[0]);
-		delete[] phitheta;
-		double dx = sin(phi) * cos(theta);
-		double dy = sin(phi) * sin(theta);
-		double dz = cos(phi);
-		glm::vec3 dir = glm::normalize(glm::vec3(dx, dy, dz));
-		rayHistory new_ray_history = { 0.0f, this->source_power / this->num_rays, 0 };
-		castRay(source_pos, dir, new_ray_history);
+	castInParallel(0, this->num_rays, [&](int thread, int begin, int end) {
+		//Buffer for the reflectors hit by the current ray
+		reflectorSequence sequence;
+		for (int i = begin; i < end; ++i) {
+			double* phitheta = halton(i, 2);
+			/*float halton_x = sampler.sample(2, i);
+			float halton_y = sampler.sample(3, i);*/
+			double theta = 2 * M_PI * phitheta[1];
+			double phi = acos(1 - 2 * phitheta[0]);
+			delete[] phitheta;
+			double dx = sin(phi) * cos(theta);
+			double dy = sin(phi) * sin(theta);
+			double dz = cos(phi);
+			glm::vec3 dir = glm::normalize(glm::vec3(dx, dy, dz));
+			sequence.clear();
+			rayHistory new_ray_history = { 0.0f, this->source_power / this->num_rays, 0, this->specular_sequences && i < this->specular_discovery_rays ? &sequence : NULL, false };
+			castRay(source_pos, dir, new_ray_history);
+		}
+	});
+}
+
+void RayTracer::OmnidirectionalGuidedSphereRayCast(PathGuide * guide)
+{
+	//If we are rendering audio again then we celar previously found paths
+	clearAudioPaths(this->paths);
+
+	guide->reset();
+	//Each iteration casts twice the rays of the previous one, so most rays use the best learned distribution.
+	//Every ray is an unbiased estimate on its own, so the rays of all iterations are kept.
+	double total_weight = pow(2, guide->iterations) - 1;
+	int cast_rays = 0;
+	for (int k = 0; k < guide->iterations; ++k) {
+		int iteration_rays = (k == guide->iterations - 1) ? this->num_rays - cast_rays : (int)(this->num_rays * pow(2, k) / total_weight);
+		//The guide is only sampled during an iteration (record is thread safe), so the rays of an iteration run in parallel
+		castInParallel(cast_rays, iteration_rays, [&](int thread, int begin, int end) {
+			//Buffer for the reflectors hit by the current ray
+			reflectorSequence sequence;
+			for (int i = begin; i < end; ++i) {
+				float pdf;
+				glm::vec3 dir = guide->sample(rayRandom(this->seed, i, 0), rayRandom(this->seed, i, 1), rayRandom(this->seed, i, 2), &pdf);
+				sequence.clear();
+				//The energy is weighted by uniform pdf / guided pdf so the expected value is the same as with uniform rays
+				rayHistory new_ray_history = { 0.0f, this->source_power / this->num_rays / pdf, 0, this->specular_sequences && i < this->specular_discovery_rays ? &sequence : NULL, false };
+				float received_energy = castRay(source_pos, dir, new_ray_history);
+				guide->record(dir, received_energy);
+			}
+		});
+		cast_rays += iteration_rays;
+		//The threads of the next iteration are new, they take the arenas of this one
+		releaseAudioArenas(this->paths);
+		guide->update();
 	}
 }
 
 void RayTracer::viewDirRayCast(Scene * scene, Camera * camera, Source * source) {
-	rayHistory new_ray_history = { 0.0f, 1.0f, 0 };
+	rayHistory new_ray_history = { 0.0f, 1.0f, 0, NULL, false };
 	castRay(camera->pos, camera->ref - camera->pos, new_ray_history);
 }
 
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <mutex>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <unordered_set>
 #include <glm/glm.hpp>
 
 #include "Scene.h"
 #include "Camera.h"
 #include "Source.h"
+#include "PathGuide.h"
+#include "TimeHistogram.h"
 
 #define LISTENER_SPHERE_RADIUS 2.0f
 #define NUMBER_OF_RAYS 1000000
@@ -21,25 +27,152 @@
 //typedef signed short SAMPLE_TYPE;
 typedef float SAMPLE_TYPE;
 
+typedef struct reflectorID {
+	unsigned int geomID;
+	unsigned int primID;
+} reflectorID;
+
+inline bool operator==(const reflectorID & a, const reflectorID & b) {
+	return a.geomID == b.geomID && a.primID == b.primID;
+}
+
+//Sequence of reflectors hit by a path. Identifies a specular path independently of the source and listener positions.
+typedef std::vector<reflectorID> reflectorSequence;
+
+struct reflectorSequenceHash {
+	size_t operator()(const reflectorSequence & sequence) const {
+		//FNV-1a over the ids
+		size_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < sequence.size(); i++) {
+			hash = (hash ^ sequence[i].geomID) * 1099511628211ULL;
+			hash = (hash ^ sequence[i].primID) * 1099511628211ULL;
+		}
+		return hash;
+	}
+};
+
+typedef struct specularSequences {
+	std::unordered_set<reflectorSequence, reflectorSequenceHash> set;
+	std::mutex mutex;
+} specularSequences;
+
 typedef struct rayHistory {
 	float travelled_distance;
 	float remaining_energy_factor;
 	int reflection_num;
+	//Reflectors hit so far. Only recorded while reflection_num <= specular_order, NULL if not needed.
+	reflectorSequence * reflectors;
+	//Reflected on a dynamic object (see RayTracer::dynamic_early_reflections)
+	bool dynamic_reflection;
 } rayHistory;
 
 typedef struct audioPath {
 	float travelled_distance;
 	float remaining_energy_factor;
 	bool is_direct_path;
+	int reflection_order;
 } audioPath;
 
-typedef struct audioPaths {
-	audioPath * ptr;
+//Capacity of the first chunk of an arena. Every new chunk doubles the previous one.
+#define AUDIO_PATHS_FIRST_CHUNK 4096
+//Stored arrival times are integer ticks of 1 / AUDIO_PATH_TICKS_PER_SECOND s. It is a multiple of 44100, 48000, 96000 and
+//192000, so binning at those rates is exact, and an unsigned int holds up to 152 s.
+#define AUDIO_PATH_TICKS_PER_SECOND 28224000
+//Stored reflection orders are saturated to AUDIO_PATH_MAX_ORDER, the remaining bit is the direct path flag
+#define AUDIO_PATH_MAX_ORDER 127
+#define AUDIO_PATH_DIRECT 0x80
+
+/*Paths are stored as a structure of arrays (9 bytes per path) allocated as one block. Binning only reads arrival and
+energy.*/
+typedef struct audioPathChunk {
+	unsigned int * arrival;
+	float * energy;
+	unsigned char * order;		//Reflection order | AUDIO_PATH_DIRECT
 	size_t size;
-	//paths are used by audio library thread and main thread. (And possibly multiple rayCasting threads)
+	size_t capacity;
+} audioPathChunk;
+
+/*Paths added by one thread. Chunks never move once allocated, so adding a path never copies the stored ones, and
+clearing keeps them so the next render reuses the memory.*/
+typedef struct audioPathArena {
+	std::thread::id owner;		//Default id if the arena is free to be taken by any thread
+	std::vector<audioPathChunk> chunks;
+	size_t current;				//Chunk being filled
+	TimeHistogram histogram;	//Energy binned by this thread when the paths are streamed
+} audioPathArena;
+
+typedef struct audioPaths {
+	//One arena per thread that adds paths. The mutex is only taken the first time a thread adds to these paths.
+	std::vector<audioPathArena*> arenas;
 	std::mutex * mutex;
+	//Each thread caches its arena by (id, generation). Ids are never reused, the generation changes when the paths are cleared.
+	unsigned long long id;
+	unsigned int generation;
+	//If histogram_size is not 0 the paths are not stored: their energy is added to the Rs bin of their arrival time
+	//(histogram_sample_rate bins per second) in the histogram of the arena. Direct paths are still stored.
+	unsigned int histogram_sample_rate;
+	size_t histogram_size;
+	size_t histogram_fine_size;		//Samples with a bin each before the bins get coarser. 0 for one bin per sample.
 } audioPaths;
 
+void initAudioPaths(audioPaths * paths);
+//Appends a path to paths. Thread safe, and lock free once the calling thread has its arena.
+void addAudioPath(audioPaths * paths, audioPath path);
+//Same as addAudioPath for many paths at once
+void addAudioPaths(audioPaths * paths, const std::vector<audioPath> & new_paths);
+//The following ones can't run while other threads are adding paths.
+size_t audioPathCount(audioPaths * paths);
+//Empties paths but keeps their memory for the next render. The arenas are released so any thread can take them.
+void clearAudioPaths(audioPaths * paths);
+//Releases the arenas keeping their paths, so the threads of the next cast take them instead of allocating new ones
+void releaseAudioArenas(audioPaths * paths);
+void freeAudioPaths(audioPaths * paths);
+//Streams the next paths into histograms of size samples with fine_size sample accurate bins (see TimeHistogram).
+//A size of 0 goes back to storing every path.
+void streamAudioPaths(audioPaths * paths, unsigned int sample_rate, size_t size, size_t fine_size);
+//Adds the histograms of all the threads to rs
+void reduceAudioHistogram(audioPaths * paths, std::vector<float> * rs);
+/*Adds the histograms of all the threads to total, which must have their layout, and empties them. The stored paths are
+kept. The arenas are released, so the threads of the next cast take them again instead of allocating new ones.*/
+void drainAudioHistogram(audioPaths * paths, TimeHistogram * total);
+//Adds the energy of the stored paths to the rs bin of their arrival time, with sample_rate bins per second
+void binAudioPaths(audioPaths * paths, unsigned int sample_rate, std::vector<float> * rs);
+/*Same as binAudioPaths, but as if the paths had been traced with reflexion_coef and max_reflexions instead of
+traced_reflexion_coef. The energy of a path only depends on the coefficient through coef^order, so every path is scaled by
+(reflexion_coef / traced_reflexion_coef)^order and the ones a trace with max_reflexions wouldn't find are dropped.*/
+void reweightAudioPaths(audioPaths * paths, unsigned int sample_rate, float traced_reflexion_coef, float reflexion_coef, int max_reflexions, std::vector<float> * rs);
+
+//Calls f(path) for every path, in no particular order. The distance is rebuilt from the quantized arrival time.
+template <typename F>
+void forEachAudioPath(audioPaths * paths, F f) {
+	for (size_t a = 0; a < paths->arenas.size(); a++) {
+		const std::vector<audioPathChunk> & chunks = paths->arenas[a]->chunks;
+		for (size_t c = 0; c < chunks.size(); c++) {
+			const audioPathChunk & chunk = chunks[c];
+			for (size_t i = 0; i < chunk.size; i++) {
+				audioPath path;
+				path.travelled_distance = (float)(chunk.arrival[i] * ((double)SPEED_OF_SOUND / AUDIO_PATH_TICKS_PER_SECOND));
+				path.remaining_energy_factor = chunk.energy[i];
+				path.is_direct_path = (chunk.order[i] & AUDIO_PATH_DIRECT) != 0;
+				path.reflection_order = chunk.order[i] & AUDIO_PATH_MAX_ORDER;
+				f(path);
+			}
+		}
+	}
+}
+
+/*Random number in [0, 1) for one dimension of a ray. It is the output of splitmix64 seeded with seed at position
+ray * RAY_RANDOM_DIMENSIONS + dimension, so it only depends on those: a ray gets the same direction whatever thread casts
+it, and a cast can be resumed or split at any ray.*/
+#define RAY_RANDOM_DIMENSIONS 4
+inline double rayRandom(unsigned long long seed, unsigned long long ray, unsigned int dimension) {
+	unsigned long long z = seed + 0x9E3779B97F4A7C15ULL * (ray * RAY_RANDOM_DIMENSIONS + dimension + 1);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
 typedef struct intersectionData {
 	float distance_to_sphere;
 	float distance_inside_sphere;
@@ -50,17 +183,45 @@ typedef struct timeInterval {
 	unsigned int end;
 } timeInterval;
 
+//Absorption and maximum reflection order for which Rs is regenerated from an already traced set of paths
+typedef struct reweightSetting {
+	float absorbtion_coef;
+	int max_reflexions;
+} reweightSetting;
+
 class RayTracer {
 public:
 	Scene * scene;
 	glm::vec3 listener_pos;
 	float listener_size;
+	//If true the listener radius grows with the path length so every ray keeps the same chance of reaching it.
+	//listener_size is then the minimum radius, used for the early arrivals.
+	bool adaptive_listener;
 	glm::vec3 source_pos;
 	float source_power;
 	audioPaths * paths;
 	int max_reflexions;
 	float reflexion_coef;
 	int num_rays;
+	//Paths with less reflections than this are not stored. Used when the early reflections are computed by another method (e.g. image sources).
+	int min_reflexion_order;
+	//The early reflections method only covers the static geometry (image sources), so min_reflexion_order doesn't discard
+	//the paths that reflected on a dynamic object
+	bool dynamic_early_reflections;
+	//Paths longer than this are not stored and rays stop once they travel it. Used when the late part of the response
+	//is computed by another method (e.g. radiance transfer). Infinite by default.
+	float max_path_distance;
+	//If specular_sequences is set, paths with up to specular_order reflections are not stored. Instead their reflector
+	//sequence is added to the set so the exact path can be computed afterwards.
+	int specular_order;
+	specularSequences * specular_sequences;
+	//Only the first specular_discovery_rays rays record their sequence. The early hits of the rest are discarded because
+	//those paths are already known. All the rays by default.
+	int specular_discovery_rays;
+	//Threads that cast the rays. The hardware concurrency by default.
+	int num_threads;
+	//Seed of the random ray directions (see rayRandom). Taken from the clock by default.
+	unsigned long long seed;
 public:
 	RayTracer(Scene * scene,
 		glm::vec3 listener_pos,
@@ -72,23 +233,40 @@ public:
 		float reflexion_coef,
 		int num_rays);
 
-	float rayIntensity(float remaining_energy, float distance_inside_sphere);
+	float rayIntensity(float remaining_energy, float distance_inside_sphere, float radius);
+
+	//Radius of the listener for a path of length path_distance
+	float listenerRadius(float path_distance);
+
+	//False if the path of history is computed by the early reflections method (see min_reflexion_order)
+	bool isStoredOrder(const rayHistory & history);
+
+	void addSpecularSequence(reflectorSequence * sequence);
 
 	//Returns the distance to the intersection if there is one, -1 if not.
-	intersectionData raySphereIntersection(glm::vec3 origin, glm::vec3 dir, glm::vec3 center);
+	intersectionData raySphereIntersection(glm::vec3 origin, glm::vec3 dir, glm::vec3 center, float radius);
 
 	/*
 	 * Cast a single ray with origin (ox, oy, oz) and direction
 	 * (dx, dy, dz).
 	 */
 	 //This function needs to do the intersection with the sound source and the reflection of the ray if it collides with geometry
-	void castRay(
+	 //Returns the energy delivered to the listener, 0 if the ray doesn't reach it.
+	float castRay(
 		glm::vec3 origin,
 		glm::vec3 dir,
 		rayHistory history);
 
+	//Splits the rays first_ray to first_ray + count - 1 in num_threads contiguous ranges and runs cast(thread, begin, end) for each one in its own thread
+	void castInParallel(int first_ray, int count, const std::function<void(int, int, int)> & cast);
+
 	void OmnidirectionalUniformSphereRayCast();
+	//Casts the uniform rays first_ray to first_ray + count - 1 of a cast of total_rays rays (each one carries
+	//source_power / total_rays) without clearing the paths first
+	void UniformSphereRayRange(unsigned long long first_ray, int count, unsigned long long total_rays);
 	void OmnidirectionalHaltonSphereRayCast();
+	//Learns the directions that reach the listener during the first iterations and samples them more often in the next ones
+	void OmnidirectionalGuidedSphereRayCast(PathGuide * guide);
 
 	void viewDirRayCast(Scene * scene, Camera * camera, Source * source);
 
@@ -0,0 +1,210 @@
+#include "BeamTracer.h"
+
+#include <cmath>
+
+BeamTracer::BeamTracer(Scene * scene, float source_power, int max_order, float reflexion_coef, int subdivisions, int max_splits) {
+	this->scene = scene;
+	this->source_power = source_power;
+	this->max_order = max_order;
+	this->reflexion_coef = reflexion_coef;
+	this->subdivisions = subdivisions;
+	this->max_splits = max_splits;
+	this->beams_traced = 0;
+}
+
+//Splits the spherical triangle a, b, c in 4 and appends the resulting triangles after subdivisions levels
+static void subdivideSphericalTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, int subdivisions, std::vector<glm::vec3> * triangles) {
+	if (subdivisions == 0) {
+		triangles->push_back(a);
+		triangles->push_back(b);
+		triangles->push_back(c);
+		return;
+	}
+	glm::vec3 ab = glm::normalize(a + b);
+	glm::vec3 bc = glm::normalize(b + c);
+	glm::vec3 ca = glm::normalize(c + a);
+	subdivideSphericalTriangle(a, ab, ca, subdivisions - 1, triangles);
+	subdivideSphericalTriangle(ab, b, bc, subdivisions - 1, triangles);
+	subdivideSphericalTriangle(ca, bc, c, subdivisions - 1, triangles);
+	subdivideSphericalTriangle(ab, bc, ca, subdivisions - 1, triangles);
+}
+
+void BeamTracer::render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths) {
+	this->source_pos = source_pos;
+	this->listener_pos = listener_pos;
+	this->paths = paths;
+	this->found.clear();
+	this->beams_traced = 0;
+
+	//Icosahedron
+	float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+	glm::vec3 vertices[12] = {
+		glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+		glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+		glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+	};
+	int faces[60] = {
+		0, 11, 5,	0, 5, 1,	0, 1, 7,	0, 7, 10,	0, 10, 11,
+		1, 5, 9,	5, 11, 4,	11, 10, 2,	10, 7, 6,	7, 1, 8,
+		3, 9, 4,	3, 4, 2,	3, 2, 6,	3, 6, 8,	3, 8, 9,
+		4, 9, 5,	2, 4, 11,	6, 2, 10,	8, 6, 7,	9, 8, 1
+	};
+	std::vector<glm::vec3> triangles;
+	for (int i = 0; i < 20; i++) {
+		subdivideSphericalTriangle(glm::normalize(vertices[faces[i * 3]]), glm::normalize(vertices[faces[i * 3 + 1]]), glm::normalize(vertices[faces[i * 3 + 2]]), this->subdivisions, &triangles);
+	}
+
+	for (int i = 0; i < triangles.size(); i += 3) {
+		beam b;
+		b.apex = source_pos;
+		b.dirs[0] = triangles[i];
+		b.dirs[1] = triangles[i + 1];
+		b.dirs[2] = triangles[i + 2];
+		b.splits = 0;
+		traceBeam(&b);
+	}
+}
+
+void BeamTracer::traceBeam(beam * b) {
+	this->beams_traced++;
+
+	//Reflected beams start at the plane of their last reflector. In the unfolded (image) space the rays go straight from
+	//the apex, so they are cast from the apex with tnear at the plane.
+	glm::vec3 plane_point, plane_normal;
+	bool reflected = !b->reflectors.empty();
+	if (reflected) {
+		glm::vec3 triangle[3];
+		this->scene->getTriangle(b->reflectors.back().geomID, b->reflectors.back().primID, triangle);
+		plane_point = triangle[0];
+		plane_normal = glm::normalize(glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]));
+	}
+
+	glm::vec3 dirs[4] = { b->dirs[0], b->dirs[1], b->dirs[2], glm::normalize(b->dirs[0] + b->dirs[1] + b->dirs[2]) };
+	reflectorID hits[4];
+	bool same_reflector = true;
+	bool any_hit = false;
+
+	struct RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	for (int i = 0; i < 4; i++) {
+		float tnear = 0;
+		if (reflected) {
+			float denominator = glm::dot(dirs[i], plane_normal);
+			tnear = fabs(denominator) > 1e-9 ? glm::dot(plane_point - b->apex, plane_normal) / denominator : 0;
+			tnear = glm::max(tnear, 0.0f) + 0.001f;
+		}
+		struct RTCRayHit rayhit;
+		rayhit.ray.org_x = b->apex.x;
+		rayhit.ray.org_y = b->apex.y;
+		rayhit.ray.org_z = b->apex.z;
+		rayhit.ray.dir_x = dirs[i].x;
+		rayhit.ray.dir_y = dirs[i].y;
+		rayhit.ray.dir_z = dirs[i].z;
+		rayhit.ray.tnear = tnear;
+		rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+		rayhit.ray.mask = -1;
+		rayhit.ray.flags = 0;
+		rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+		rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+		rtcIntersect1(this->scene->getRTCScene(), &context, &rayhit);
+
+		hits[i] = { this->scene->hitObject(rayhit.hit), rayhit.hit.primID };
+		if (rayhit.hit.geomID != RTC_INVALID_GEOMETRY_ID) {
+			any_hit = true;
+		}
+		if (i > 0 && !(hits[i] == hits[0])) {
+			same_reflector = false;
+		}
+	}
+
+	//Split the beam so its parts follow the edges of the triangles it hits
+	if (!same_reflector && b->splits < this->max_splits) {
+		glm::vec3 mid01 = glm::normalize(b->dirs[0] + b->dirs[1]);
+		glm::vec3 mid12 = glm::normalize(b->dirs[1] + b->dirs[2]);
+		glm::vec3 mid20 = glm::normalize(b->dirs[2] + b->dirs[0]);
+		glm::vec3 sub_dirs[12] = {
+			b->dirs[0], mid01, mid20,
+			mid01, b->dirs[1], mid12,
+			mid20, mid12, b->dirs[2],
+			mid01, mid12, mid20
+		};
+		for (int i = 0; i < 4; i++) {
+			beam sub_beam;
+			sub_beam.apex = b->apex;
+			sub_beam.dirs[0] = sub_dirs[i * 3];
+			sub_beam.dirs[1] = sub_dirs[i * 3 + 1];
+			sub_beam.dirs[2] = sub_dirs[i * 3 + 2];
+			sub_beam.reflectors = b->reflectors;
+			sub_beam.splits = b->splits + 1;
+			traceBeam(&sub_beam);
+		}
+		return;
+	}
+
+	if (containsListener(b)) {
+		addListenerPath(b);
+	}
+
+	if (!any_hit || b->reflectors.size() >= this->max_order) {
+		return;
+	}
+
+	//If the beam couldn't be resolved it follows its center ray
+	reflectorID reflector = same_reflector ? hits[0] : hits[3];
+	if (reflector.geomID == RTC_INVALID_GEOMETRY_ID) {
+		return;
+	}
+	glm::vec3 triangle[3];
+	this->scene->getTriangle(reflector.geomID, reflector.primID, triangle);
+	glm::vec3 normal = glm::normalize(glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]));
+
+	beam reflected_beam;
+	reflected_beam.apex = mirrorPoint(b->apex, triangle);
+	for (int i = 0; i < 3; i++) {
+		reflected_beam.dirs[i] = glm::reflect(b->dirs[i], normal);
+	}
+	reflected_beam.reflectors = b->reflectors;
+	reflected_beam.reflectors.push_back(reflector);
+	reflected_beam.splits = 0;
+	traceBeam(&reflected_beam);
+}
+
+bool BeamTracer::containsListener(beam * b) {
+	glm::vec3 to_listener = this->listener_pos - b->apex;
+	for (int i = 0; i < 3; i++) {
+		glm::vec3 normal = glm::cross(b->dirs[i], b->dirs[(i + 1) % 3]);
+		//The side of the plane that contains the opposite corner is the inside
+		float inside = glm::dot(normal, b->dirs[(i + 2) % 3]);
+		if (glm::dot(normal, to_listener) * inside < 0) {
+			return false;
+		}
+	}
+	return glm::dot(to_listener, b->dirs[0] + b->dirs[1] + b->dirs[2]) > 0;
+}
+
+void BeamTracer::addListenerPath(beam * b) {
+	//Neighbouring beams can share the listener if it lies on their common edge
+	if (!this->found.insert(b->reflectors).second) {
+		return;
+	}
+	int order = b->reflectors.size();
+	std::vector<glm::vec3> images(order + 1);
+	images[0] = this->source_pos;
+	for (int k = 1; k <= order; k++) {
+		glm::vec3 triangle[3];
+		this->scene->getTriangle(b->reflectors[k - 1].geomID, b->reflectors[k - 1].primID, triangle);
+		images[k] = mirrorPoint(images[k - 1], triangle);
+	}
+	if (!isSpecularPathValid(this->scene, images, b->reflectors, this->listener_pos)) {
+		return;
+	}
+	float distance = glm::length(this->listener_pos - images[order]);
+	audioPath path = { distance, specularPathEnergy(this->source_power, this->reflexion_coef, order, distance), order == 0, order };
+	addAudioPath(this->paths, path);
+}
+
+BeamTracer::~BeamTracer() {
+
+}
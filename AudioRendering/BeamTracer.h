@@ -0,0 +1,61 @@
+#pragma once
+/*Beam tracing engine for the early specular reflections. The sphere around the source is divided in triangular beams
+(a subdivided icosahedron), so the beams cover every direction exactly once and there is no sampling noise. Each beam
+is traced with its three corner rays and its center ray. If they all hit the same triangle the whole beam is reflected
+by mirroring its apex (the image source) across the triangle's plane. If they don't, the beam is split in four at the
+midpoints of its edges, so beams end up following the edges of the triangles in the scene.
+
+The listener is tested against every beam. A listener inside a beam gives a candidate reflector sequence whose exact
+path is validated like the image source paths.*/
+
+#include <embree3/rtcore.h>
+#include <embree3/rtcore_common.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_set>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+#include "ImageSource.h"
+
+#define BEAM_TRACING_SUBDIVISIONS 2
+#define BEAM_TRACING_MAX_SPLITS 5
+
+typedef struct beam {
+	glm::vec3 apex;					//Image source the beam diverges from
+	glm::vec3 dirs[3];				//Corner directions
+	reflectorSequence reflectors;	//Reflectors the beam went through. The last one is where the beam starts.
+	int splits;						//Times this beam was split since the last reflection
+} beam;
+
+class BeamTracer {
+public:
+	Scene * scene;
+	float source_power;
+	int max_order;
+	float reflexion_coef;
+	//Icosahedron subdivisions for the initial beams. There are 20 * 4^subdivisions of them.
+	int subdivisions;
+	//Maximum times a beam can be split before following its center ray
+	int max_splits;
+	//Statistics of the last render
+	int beams_traced;
+
+private:
+	glm::vec3 source_pos;
+	glm::vec3 listener_pos;
+	audioPaths * paths;
+	std::unordered_set<reflectorSequence, reflectorSequenceHash> found;
+
+public:
+	BeamTracer(Scene * scene, float source_power, int max_order, float reflexion_coef, int subdivisions, int max_splits);
+
+	//Adds to paths every specular path with up to max_order reflections between source_pos and listener_pos
+	void render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths);
+
+	void traceBeam(beam * b);
+	bool containsListener(beam * b);
+	void addListenerPath(beam * b);
+
+	~BeamTracer();
+};
@@ -0,0 +1,247 @@
+#include "BidirectionalPathTracer.h"
+
+#include <cmath>
+
+#include "ImageSource.h"
+
+BidirectionalPathTracer::BidirectionalPathTracer(float scattering, int num_paths) {
+	this->scattering = scattering;
+	this->num_paths = num_paths;
+}
+
+float BidirectionalPathTracer::directionPdf(const pathVertex & vertex, glm::vec3 target) {
+	if (!vertex.on_surface) {
+		return 1 / (4 * M_PI);
+	}
+	if (vertex.delta) {
+		return 0;
+	}
+	float cosine = glm::dot(vertex.normal, glm::normalize(target - vertex.pos));
+	return cosine > 0 ? this->scattering * cosine / M_PI : 0;
+}
+
+float BidirectionalPathTracer::convertDensity(float pdf, const pathVertex & from, const pathVertex & to) {
+	glm::vec3 dir = to.pos - from.pos;
+	float distance2 = glm::dot(dir, dir);
+	if (distance2 == 0) {
+		return 0;
+	}
+	if (to.on_surface) {
+		pdf *= fabs(glm::dot(to.normal, dir / sqrtf(distance2)));
+	}
+	return pdf / distance2;
+}
+
+void BidirectionalPathTracer::traceSubPath(RayTracer * rt, glm::vec3 dir, std::vector<pathVertex> * vertices, int max_vertices,
+	std::mt19937 * generator, audioPaths * paths) {
+	std::uniform_real_distribution<float> uniform01(0.0f, 1.0f);
+	struct RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	float pdf_fwd = 1 / (4 * M_PI);
+	//True once two consecutive vertices (the source included) scattered diffusely, so the path can be connected
+	bool connectable = false;
+	while (true) {
+		pathVertex * prev = &vertices->back();
+		struct RTCRayHit rayhit;
+		rayhit.ray.org_x = prev->pos.x;
+		rayhit.ray.org_y = prev->pos.y;
+		rayhit.ray.org_z = prev->pos.z;
+		rayhit.ray.dir_x = dir.x;
+		rayhit.ray.dir_y = dir.y;
+		rayhit.ray.dir_z = dir.z;
+		rayhit.ray.tnear = prev->on_surface ? 0.001f : 0.0f;
+		rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+		rayhit.ray.mask = -1;
+		rayhit.ray.flags = 0;
+		rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+		rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+		rtcIntersect1(rt->scene->getRTCScene(), &context, &rayhit);
+
+		//Energy that leaves prev in dir
+		float energy = prev->on_surface ? prev->throughput * rt->reflexion_coef : prev->throughput;
+		int order = vertices->size() - 1;
+		if (paths && !connectable && prev->delta) {
+			//The last vertex can't be connected to the listener either, so the sphere is the only way to find this path
+			float closest_distance = glm::max(glm::dot(rt->listener_pos - prev->pos, dir), 0.0f);
+			float radius = rt->listenerRadius(prev->distance + closest_distance);
+			intersectionData sphere = rt->raySphereIntersection(prev->pos, dir, rt->listener_pos, radius);
+			float path_distance = prev->distance + sphere.distance_to_sphere;
+			if (sphere.distance_to_sphere >= 0 && sphere.distance_to_sphere < rayhit.ray.tfar
+				&& order >= rt->min_reflexion_order && path_distance <= rt->max_path_distance) {
+				audioPath path = { path_distance, rt->rayIntensity(energy, sphere.distance_inside_sphere, radius), false, order };
+				addAudioPath(paths, path);
+			}
+		}
+
+		if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID || order >= max_vertices) {
+			return;
+		}
+
+		pathVertex vertex;
+		vertex.pos = prev->pos + dir * rayhit.ray.tfar;
+		glm::vec3 normal = rt->scene->hitNormal(rayhit.hit);
+		vertex.normal = glm::dot(dir, normal) < 0 ? normal : -normal;
+		vertex.on_surface = true;
+		vertex.throughput = energy;
+		vertex.distance = prev->distance + rayhit.ray.tfar;
+		vertex.pdf_rev = 0;
+		vertex.pdf_fwd = convertDensity(pdf_fwd, *prev, vertex);
+
+		//Choose the diffuse part with probability scattering. Both parts reflect reflexion_coef of the energy, so
+		//the throughput is the same for both.
+		float pdf_rev;
+		if (uniform01(*generator) < this->scattering) {
+			vertex.delta = false;
+			//Cosine distributed direction around the normal
+			glm::vec3 tangent = glm::normalize(fabs(vertex.normal.x) > 0.9f ? glm::cross(vertex.normal, glm::vec3(0, 1, 0)) : glm::cross(vertex.normal, glm::vec3(1, 0, 0)));
+			glm::vec3 bitangent = glm::cross(vertex.normal, tangent);
+			float r1 = uniform01(*generator);
+			float phi = 2 * M_PI * uniform01(*generator);
+			float radius = sqrtf(r1);
+			glm::vec3 new_dir = radius * cosf(phi) * tangent + radius * sinf(phi) * bitangent + sqrtf(1 - r1) * vertex.normal;
+			pdf_fwd = this->scattering * glm::dot(new_dir, vertex.normal) / M_PI;
+			pdf_rev = this->scattering * glm::dot(-dir, vertex.normal) / M_PI;
+			dir = new_dir;
+			if (!prev->delta) {
+				connectable = true;
+			}
+		}
+		else {
+			vertex.delta = true;
+			dir = glm::reflect(dir, vertex.normal);
+			pdf_fwd = 0;
+			pdf_rev = 0;
+		}
+		prev->pdf_rev = convertDensity(pdf_rev, vertex, *prev);
+		vertices->push_back(vertex);
+	}
+}
+
+float BidirectionalPathTracer::misWeight(std::vector<pathVertex> & light, int s, std::vector<pathVertex> & eye, int t) {
+	pathVertex * qs = &light[s];
+	pathVertex * pt = &eye[t];
+	//Reverse densities of the connected vertices and their predecessors, computed for the connection
+	float saved[4] = { qs->pdf_rev, pt->pdf_rev, s > 0 ? light[s - 1].pdf_rev : 0, t > 0 ? eye[t - 1].pdf_rev : 0 };
+	//The connected vertices scatter diffusely in this path, whatever part their sub paths sampled to go on
+	bool saved_delta[2] = { qs->delta, pt->delta };
+	qs->delta = false;
+	pt->delta = false;
+	pt->pdf_rev = convertDensity(directionPdf(*qs, pt->pos), *qs, *pt);
+	qs->pdf_rev = convertDensity(directionPdf(*pt, qs->pos), *pt, *qs);
+	if (s > 0) {
+		light[s - 1].pdf_rev = convertDensity(directionPdf(*qs, light[s - 1].pos), *qs, light[s - 1]);
+	}
+	if (t > 0) {
+		eye[t - 1].pdf_rev = convertDensity(directionPdf(*pt, eye[t - 1].pos), *pt, eye[t - 1]);
+	}
+
+	//Ratio between the density of every other strategy and this one. Zero densities come from specular vertices and
+	//cancel out, so they are taken as 1 and the strategies that connect through a specular vertex are skipped.
+	auto remap = [](float pdf) { return pdf != 0 ? pdf : 1; };
+	float sum = 0;
+	float ratio = 1;
+	for (int i = t; i > 0; i--) {
+		ratio *= remap(eye[i].pdf_rev) / remap(eye[i].pdf_fwd);
+		if (!eye[i].delta && !eye[i - 1].delta) {
+			sum += ratio;
+		}
+	}
+	ratio = 1;
+	//light[0] is the point source, which is never hit by the listener sub path
+	for (int i = s; i > 0; i--) {
+		ratio *= remap(light[i].pdf_rev) / remap(light[i].pdf_fwd);
+		if (!light[i].delta && !light[i - 1].delta) {
+			sum += ratio;
+		}
+	}
+
+	qs->pdf_rev = saved[0];
+	pt->pdf_rev = saved[1];
+	if (s > 0) {
+		light[s - 1].pdf_rev = saved[2];
+	}
+	if (t > 0) {
+		eye[t - 1].pdf_rev = saved[3];
+	}
+	qs->delta = saved_delta[0];
+	pt->delta = saved_delta[1];
+	return 1 / (1 + sum);
+}
+
+void BidirectionalPathTracer::render(RayTracer * rt) {
+	//If we are rendering audio again then we celar previously found paths
+	clearAudioPaths(rt->paths);
+	//Seeded like the ray tracer, so the same SEED gives the same response
+	std::seed_seq seed = { (unsigned int)rt->seed, (unsigned int)(rt->seed >> 32) };
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<double> uniform01(0.0, 1.0);
+
+	int num_paths = this->num_paths > 0 ? this->num_paths : rt->num_rays;
+	//Diffuse part of the reflection (the specular part doesn't contribute to a connection). The throughput of a vertex is
+	//the energy that arrives to it, so a vertex can be connected whichever part its sub path sampled to go on.
+	float brdf = rt->reflexion_coef * this->scattering / M_PI;
+
+	//The direct path is deterministic, so it is added once instead of once per sample
+	if (rt->min_reflexion_order == 0 && isSegmentVisible(rt->scene, rt->source_pos, rt->listener_pos)) {
+		float distance = glm::length(rt->listener_pos - rt->source_pos);
+		audioPath direct = { distance, specularPathEnergy(rt->source_power, rt->reflexion_coef, 0, distance), true, 0 };
+		addAudioPath(rt->paths, direct);
+	}
+
+	std::vector<pathVertex> light;
+	std::vector<pathVertex> eye;
+	for (int n = 0; n < num_paths; n++) {
+		glm::vec3 dirs[2];
+		for (int k = 0; k < 2; k++) {
+			double theta = 2 * M_PI * uniform01(generator);
+			double phi = acos(1 - 2 * uniform01(generator));
+			dirs[k] = glm::normalize(glm::vec3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)));
+		}
+		light.clear();
+		light.push_back({ rt->source_pos, glm::vec3(0), false, false, 1, 0, rt->source_power / num_paths, 0 });
+		traceSubPath(rt, dirs[0], &light, rt->max_reflexions, &generator, rt->paths);
+		//Importance of the listener: the intensity is the radiance integrated over the sphere of directions
+		eye.clear();
+		eye.push_back({ rt->listener_pos, glm::vec3(0), false, false, 1, 0, (float)(4 * M_PI), 0 });
+		traceSubPath(rt, dirs[1], &eye, rt->max_reflexions, &generator, NULL);
+
+		for (int s = 0; s < light.size(); s++) {
+			for (int t = 0; t < eye.size() && s + t <= rt->max_reflexions; t++) {
+				//The orders below min_reflexion_order are added by another engine
+				int order = s + t;
+				if (order == 0 || order < rt->min_reflexion_order) {
+					continue;
+				}
+				pathVertex * x = &light[s];
+				pathVertex * y = &eye[t];
+				glm::vec3 dir = y->pos - x->pos;
+				float distance = glm::length(dir);
+				float path_distance = x->distance + distance + y->distance;
+				if (distance < 1e-4 || path_distance > rt->max_path_distance) {
+					continue;
+				}
+				dir /= distance;
+				//A diffuse vertex reflects to the side it was reached from
+				float cos_x = x->on_surface ? glm::dot(x->normal, dir) : 1;
+				float cos_y = y->on_surface ? glm::dot(y->normal, -dir) : 1;
+				if (cos_x <= 0 || cos_y <= 0) {
+					continue;
+				}
+				//Intensity at y from x, and what y contributes to the listener for it
+				float energy = x->throughput * (x->on_surface ? brdf * cos_x : 1 / (4 * M_PI)) * cos_y / (distance * distance);
+				energy *= y->on_surface ? y->throughput * brdf : 1;
+				if (energy <= 0 || !isSegmentVisible(rt->scene, x->pos, y->pos)) {
+					continue;
+				}
+				audioPath path = { path_distance, energy * misWeight(light, s, eye, t), false, order };
+				addAudioPath(rt->paths, path);
+			}
+		}
+	}
+}
+
+BidirectionalPathTracer::~BidirectionalPathTracer() {
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+/*Bidirectional path tracing for listeners that are hard to reach from the source (behind a partial wall, in a coupled
+room...). For every sample a sub path is traced from the source and another one from the listener, and every vertex
+of the first is connected to every vertex of the second with a visibility ray. Each connection is weighted with the
+balance heuristic over all the ways the same path could have been sampled.
+
+Connections need a scattering surface at both ends, so the reflections are a mix of a diffuse (Lambertian) part with
+weight scattering and a specular part with weight 1 - scattering. Paths that can't be connected anywhere (specular
+reflections next to each other at every vertex) are counted when the source sub path crosses the listener's sphere,
+like in the ray tracer. With scattering 0 the result is the same as the ray tracer's.*/
+
+#include <embree3/rtcore.h>
+#include <embree3/rtcore_common.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <random>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+
+typedef struct pathVertex {
+	glm::vec3 pos;
+	glm::vec3 normal;		//Oriented towards the side the sub path arrived from. Unused for the end points.
+	bool on_surface;		//False for the source and the listener
+	bool delta;				//The sub path was reflected specularly at this vertex
+	float pdf_fwd;			//Area density of sampling this vertex from the previous one in its sub path
+	float pdf_rev;			//Area density of sampling this vertex from the next one (as if the sub path went the other way)
+	float throughput;		//Energy (source sub path) or importance (listener sub path) that arrives to this vertex
+	float distance;			//Length of the sub path up to this vertex
+} pathVertex;
+
+class BidirectionalPathTracer {
+public:
+	float scattering;
+	//Number of sub path pairs. If 0 the ray tracer's num_rays is used.
+	int num_paths;
+
+public:
+	BidirectionalPathTracer(float scattering, int num_paths);
+
+	//Replaces the ray cast of rt: uses its scene, positions and parameters and stores the paths in rt->paths
+	void render(RayTracer * rt);
+
+	~BidirectionalPathTracer();
+
+private:
+	//Traces a sub path from vertices[0] with the given initial direction. Stops when the ray leaves the scene or after
+	//max_vertices reflections. If paths is set the sphere hits of paths that can't be connected are added to it.
+	void traceSubPath(RayTracer * rt, glm::vec3 dir, std::vector<pathVertex> * vertices, int max_vertices,
+		std::mt19937 * generator, audioPaths * paths);
+
+	//Density of scattering from vertex towards target, per solid angle
+	float directionPdf(const pathVertex & vertex, glm::vec3 target);
+
+	//Density per solid angle at from converted to area density at to
+	float convertDensity(float pdf, const pathVertex & from, const pathVertex & to);
+
+	//Balance heuristic weight of connecting light[s] with eye[t]
+	float misWeight(std::vector<pathVertex> & light, int s, std::vector<pathVertex> & eye, int t);
+};
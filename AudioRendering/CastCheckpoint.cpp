@@ -0,0 +1,143 @@
+#include "CastCheckpoint.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+#include <limits>
+#include <algorithm>
+
+bool saveCheckpoint(const std::string & file_path, const castCheckpoint & checkpoint) {
+	std::string temporary_path = file_path + ".tmp";
+	std::ofstream file(temporary_path);
+	if (!file) {
+		return false;
+	}
+	//17 digits are enough to read back the same double
+	file << std::setprecision(17);
+	file << "CHECKPOINT " << CHECKPOINT_VERSION << std::endl;
+	file << "seed " << checkpoint.seed << std::endl;
+	file << "config_hash " << checkpoint.config_hash << std::endl;
+	file << "total_rays " << checkpoint.total_rays << std::endl;
+	file << "first_ray " << checkpoint.first_ray << std::endl;
+	file << "end_ray " << checkpoint.end_ray << std::endl;
+	file << "next_ray " << checkpoint.next_ray << std::endl;
+	file << "num_threads " << checkpoint.num_threads << std::endl;
+	file << "sample_rate " << checkpoint.sample_rate << std::endl;
+	file << "size " << checkpoint.histogram.size << std::endl;
+	file << "fine_size " << checkpoint.histogram.fine_size << std::endl;
+	file << "bins " << checkpoint.histogram.bins.size() << std::endl;
+	for (size_t i = 0; i < checkpoint.histogram.bins.size(); i++) {
+		file << checkpoint.histogram.bins[i] << ",";
+	}
+	file << std::endl;
+	file.close();
+	if (!file) {
+		return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary_path, file_path, error);
+	return !error;
+}
+
+bool loadCheckpoint(const std::string & file_path, castCheckpoint * checkpoint) {
+	std::ifstream file(file_path);
+	std::string key;
+	int version = 0;
+	if (!(file >> key >> version) || key != "CHECKPOINT" || version != CHECKPOINT_VERSION) {
+		return false;
+	}
+	size_t size = 0, fine_size = 0, bin_count = 0;
+	file >> key >> checkpoint->seed;
+	file >> key >> checkpoint->config_hash;
+	file >> key >> checkpoint->total_rays;
+	file >> key >> checkpoint->first_ray;
+	file >> key >> checkpoint->end_ray;
+	file >> key >> checkpoint->next_ray;
+	file >> key >> checkpoint->num_threads;
+	file >> key >> checkpoint->sample_rate;
+	file >> key >> size;
+	file >> key >> fine_size;
+	file >> key >> bin_count;
+	if (!file) {
+		return false;
+	}
+	checkpoint->histogram.resize(size, fine_size);
+	if (bin_count != checkpoint->histogram.bins.size()) {
+		return false;
+	}
+	char separator;
+	for (size_t i = 0; i < bin_count; i++) {
+		file >> checkpoint->histogram.bins[i] >> separator;
+	}
+	return !file.fail();
+}
+
+void castCheckpointed(RayTracer * rt, castCheckpoint * checkpoint, unsigned long long interval, const std::string & file_path) {
+	//A batch is cast with a single call, so it has to fit in an int
+	interval = glm::clamp(interval, 1ULL, (unsigned long long)std::numeric_limits<int>::max());
+	rt->seed = checkpoint->seed;
+	rt->num_threads = checkpoint->num_threads;
+	while (checkpoint->next_ray < checkpoint->end_ray) {
+		//Batches start at multiples of interval, so a resumed run casts the same ones
+		unsigned long long batch_end = std::min(checkpoint->end_ray, (checkpoint->next_ray / interval + 1) * interval);
+		rt->UniformSphereRayRange(checkpoint->next_ray, (int)(batch_end - checkpoint->next_ray), checkpoint->total_rays);
+		drainAudioHistogram(rt->paths, &checkpoint->histogram);
+		checkpoint->next_ray = batch_end;
+		if (!file_path.empty()) {
+			if (!saveCheckpoint(file_path, *checkpoint)) {
+				std::cout << "Could not save the checkpoint to " << file_path << std::endl;
+			}
+			std::cout << "Checkpoint: " << checkpoint->next_ray - checkpoint->first_ray << " of " << checkpoint->end_ray - checkpoint->first_ray << " rays" << std::endl;
+		}
+	}
+}
+
+bool mergeCheckpoints(const std::vector<std::string> & file_paths, castCheckpoint * merged) {
+	std::vector<castCheckpoint> parts(file_paths.size());
+	for (size_t f = 0; f < file_paths.size(); f++) {
+		if (!loadCheckpoint(file_paths[f], &parts[f])) {
+			std::cout << "Could not read " << file_paths[f] << std::endl;
+			return false;
+		}
+		if (parts[f].next_ray < parts[f].end_ray) {
+			std::cout << file_paths[f] << " is not finished, only its first " << parts[f].next_ray - parts[f].first_ray << " rays are used" << std::endl;
+		}
+	}
+	if (parts.empty()) {
+		return false;
+	}
+	std::sort(parts.begin(), parts.end(), [](const castCheckpoint & a, const castCheckpoint & b) {
+		return a.first_ray < b.first_ray;
+	});
+	unsigned long long cast_rays = 0;
+	for (size_t f = 0; f < parts.size(); f++) {
+		if (parts[f].seed != parts[0].seed || parts[f].config_hash != parts[0].config_hash || parts[f].total_rays != parts[0].total_rays || parts[f].sample_rate != parts[0].sample_rate
+			|| parts[f].histogram.size != parts[0].histogram.size || parts[f].histogram.fine_size != parts[0].histogram.fine_size) {
+			std::cout << "The partial results belong to different simulations" << std::endl;
+			return false;
+		}
+		if (f > 0 && parts[f].first_ray < parts[f - 1].end_ray) {
+			std::cout << "The rays " << parts[f].first_ray << " to " << parts[f - 1].end_ray - 1 << " were cast by two shards" << std::endl;
+			return false;
+		}
+		cast_rays += parts[f].next_ray - parts[f].first_ray;
+	}
+	merged->seed = parts[0].seed;
+	merged->config_hash = parts[0].config_hash;
+	merged->total_rays = parts[0].total_rays;
+	merged->first_ray = parts.front().first_ray;
+	merged->end_ray = parts.back().end_ray;
+	merged->next_ray = parts.back().next_ray;
+	merged->num_threads = parts[0].num_threads;
+	merged->sample_rate = parts[0].sample_rate;
+	merged->histogram.resize(parts[0].histogram.size, parts[0].histogram.fine_size);
+	for (size_t f = 0; f < parts.size(); f++) {
+		merged->histogram.accumulate(parts[f].histogram);
+	}
+	if (cast_rays < merged->total_rays) {
+		std::cout << "Only " << cast_rays << " of " << merged->total_rays << " rays were cast, the energy of the rest is missing" << std::endl;
+	}
+	return true;
+}
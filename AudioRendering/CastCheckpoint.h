@@ -0,0 +1,59 @@
+#pragma once
+/*Progress of a long uniform ray cast, saved to disk so that a run that stops can be resumed. The rays are cast in
+batches in their index order and, since a ray's direction only depends on the seed and its index (see rayRandom), the
+next ray to cast is the position in the random streams. After every batch the energy of the batch is added to the
+histogram and the checkpoint is written, so a killed run loses at most one batch.
+
+A batch always covers the same rays and is added in the same way, so a resumed run gives the same bits as one that
+never stopped as long as it uses the same number of threads (it is saved in the checkpoint and used when resuming).
+
+A run can also cast only a range of the rays of a simulation (a shard), so a simulation can be split among processes or
+machines. Each one writes its finished checkpoint as a partial result, and merging them adds up the histograms.*/
+
+#include <string>
+#include <vector>
+
+#include "AudioRenderingUtils.h"
+#include "TimeHistogram.h"
+
+#define CHECKPOINT_VERSION 3
+//Rays between checkpoints by default
+#define CHECKPOINT_INTERVAL 10000000
+
+typedef struct castCheckpoint {
+	unsigned long long seed;
+	unsigned long long config_hash;		//Of the simulation file, a checkpoint of another simulation isn't resumed or merged
+	unsigned long long total_rays;		//Every ray carries source_power / total_rays
+	unsigned long long first_ray;		//The run casts the rays first_ray to end_ray - 1
+	unsigned long long end_ray;
+	unsigned long long next_ray;		//First ray not cast yet
+	int num_threads;
+	unsigned int sample_rate;
+	TimeHistogram histogram;			//Energy of the rays first_ray to next_ray - 1
+} castCheckpoint;
+
+//Rays of a simulation cast by one run of a sharded simulation
+typedef struct shardSetting {
+	unsigned long long first_ray;
+	unsigned long long count;
+	unsigned long long seed;
+} shardSetting;
+
+//File and rays between saves of a checkpointed simulation
+typedef struct checkpointSetting {
+	std::string file_path;
+	unsigned long long interval;
+} checkpointSetting;
+
+//Writes the checkpoint to a temporary file that then replaces file_path, so the previous one survives a crash while saving
+bool saveCheckpoint(const std::string & file_path, const castCheckpoint & checkpoint);
+//Returns false if there is no readable checkpoint at file_path
+bool loadCheckpoint(const std::string & file_path, castCheckpoint * checkpoint);
+/*Casts the rays checkpoint->next_ray to checkpoint->end_ray - 1 with rt in batches of interval rays and adds their
+energy to checkpoint->histogram. rt->paths must be streamed with the layout of the histogram, and the seed and threads
+of rt are replaced with those of the checkpoint. The checkpoint is saved to file_path after every batch if it isn't empty.*/
+void castCheckpointed(RayTracer * rt, castCheckpoint * checkpoint, unsigned long long interval, const std::string & file_path);
+/*Adds up the finished partial results of the shards of a simulation. They must share the simulation file, seed, rays,
+sample rate and histogram layout and cover disjoint ranges of rays. They are added in ray order, so the result doesn't depend on the
+order of the files. Missing rays are reported, their energy is left out.*/
+bool mergeCheckpoints(const std::vector<std::string> & file_paths, castCheckpoint * merged);
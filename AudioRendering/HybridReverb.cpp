@@ -0,0 +1,138 @@
+#include "HybridReverb.h"
+
+#include <iostream>
+#include <limits>
+#include <cmath>
+
+HybridReverb::HybridReverb(float echo_density, float pilot_fraction) {
+	this->echo_density = echo_density;
+	this->pilot_fraction = pilot_fraction;
+	this->mixing_time = 0;
+	this->decay_rate = 0;
+	this->found = false;
+	this->estimated = false;
+	this->geometry_version = 0;
+}
+
+void HybridReverb::prepare(RayTracer * rt) {
+	if (!this->estimated || this->geometry_version != rt->scene->geometry_version) {
+		//The pilot stores every path of every order
+		audioPaths pilot;
+		initAudioPaths(&pilot);
+		audioPaths * paths = rt->paths;
+		int num_rays = rt->num_rays;
+		int min_reflexion_order = rt->min_reflexion_order;
+		float max_path_distance = rt->max_path_distance;
+		specularSequences * specular_sequences = rt->specular_sequences;
+		rt->paths = &pilot;
+		rt->num_rays = glm::max(1, (int)(num_rays * this->pilot_fraction));
+		rt->min_reflexion_order = 0;
+		rt->max_path_distance = std::numeric_limits<float>::infinity();
+		rt->specular_sequences = NULL;
+		rt->OmnidirectionalUniformSphereRayCast();
+
+		std::vector<double> density;
+		std::vector<double> energy;		//1 ms bins
+		forEachAudioPath(&pilot, [&](const audioPath & path) {
+			float time = path.travelled_distance / SPEED_OF_SOUND;
+			size_t window = (size_t)(time / HYBRID_WINDOW);
+			size_t bin = (size_t)(time * 1000);
+			if (window >= density.size()) {
+				density.resize(window + 1, 0.0);
+			}
+			if (bin >= energy.size()) {
+				energy.resize(bin + 1, 0.0);
+			}
+			float radius = rt->listenerRadius(path.travelled_distance);
+			density[window] += 4 * path.travelled_distance * path.travelled_distance / (rt->num_rays * radius * radius) / HYBRID_WINDOW;
+			energy[bin] += path.remaining_energy_factor;
+		});
+		freeAudioPaths(&pilot);
+
+		rt->paths = paths;
+		rt->num_rays = num_rays;
+		rt->min_reflexion_order = min_reflexion_order;
+		rt->max_path_distance = max_path_distance;
+		rt->specular_sequences = specular_sequences;
+
+		this->mixing_time = 0;
+		this->decay_rate = 0;
+		bool dense = false;
+		for (size_t w = 0; w < density.size(); w++) {
+			if (density[w] >= this->echo_density) {
+				//The tail continues the level of the traced response, so at least HYBRID_MATCH_LENGTH is traced
+				this->mixing_time = glm::max(w * HYBRID_WINDOW, HYBRID_MATCH_LENGTH);
+				dense = true;
+				break;
+			}
+		}
+		//Least squares line over the first HYBRID_FIT_RANGE dB of the decay curve after the mixing time
+		size_t first = (size_t)(this->mixing_time * 1000);
+		if (dense && first < energy.size()) {
+			std::vector<double> curve(energy.begin() + first, energy.end());
+			for (int i = (int)curve.size() - 2; i >= 0; i--) {
+				curve[i] += curve[i + 1];
+			}
+			double sx = 0, sy = 0, sxx = 0, sxy = 0;
+			int n = 0;
+			for (size_t i = 0; i < curve.size() && curve[i] > 0; i++) {
+				double level = 10 * log10(curve[i] / curve[0]);
+				if (level < -HYBRID_FIT_RANGE) {
+					break;
+				}
+				double t = i / 1000.0;
+				sx += t;
+				sy += level;
+				sxx += t * t;
+				sxy += t * level;
+				n++;
+			}
+			if (n > 1 && n * sxx - sx * sx > 0) {
+				this->decay_rate = (float)((n * sxy - sx * sy) / (n * sxx - sx * sx));
+			}
+		}
+		this->found = dense && this->decay_rate < 0;
+		if (rt->scene->verbose) {
+			if (!dense) {
+				std::cout << "Hybrid reverb: the echo density doesn't reach " << this->echo_density << " reflections per second" << std::endl;
+			}
+			else if (!this->found) {
+				std::cout << "Hybrid reverb: the decay after the mixing time " << this->mixing_time * 1000 << " ms couldn't be fitted" << std::endl;
+			}
+			else {
+				std::cout << "Hybrid reverb: mixing time " << this->mixing_time * 1000 << " ms, reverberation time " << reverberationTime() << " s" << std::endl;
+			}
+		}
+		this->estimated = true;
+		this->geometry_version = rt->scene->geometry_version;
+	}
+	if (this->found) {
+		rt->max_path_distance = glm::min(rt->max_path_distance, this->mixing_time * SPEED_OF_SOUND);
+	}
+}
+
+void HybridReverb::render(std::vector<float> * rs, int sample_rate) {
+	if (!this->found) {
+		return;
+	}
+	size_t start = (size_t)round(this->mixing_time * sample_rate);
+	size_t match = glm::max((size_t)1, (size_t)round(HYBRID_MATCH_LENGTH * sample_rate));
+	if (start < match || start >= rs->size()) {
+		return;
+	}
+	double level = 0;
+	for (size_t i = start - match; i < start; i++) {
+		level += (*rs)[i];
+	}
+	//The average is the level at the middle of the window, half a window before the mixing time
+	level = level / match * pow(10.0, this->decay_rate * (HYBRID_MATCH_LENGTH / 2) / 10);
+	double step = pow(10.0, this->decay_rate / sample_rate / 10);
+	for (size_t i = start; i < rs->size(); i++) {
+		(*rs)[i] += (float)level;
+		level *= step;
+	}
+}
+
+float HybridReverb::reverberationTime() {
+	return this->decay_rate < 0 ? -60 / this->decay_rate : 0;
+}
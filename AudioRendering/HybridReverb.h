@@ -0,0 +1,44 @@
+#pragma once
+/*Hybrid late reverberation. Once the reflections arriving at the listener are dense enough (the mixing time) their
+exact arrival times no longer matter, so the ray tracer stops there and the rest of the response is an exponential
+decay that continues the traced part.
+
+A pilot cast with a fraction of the rays and the full depth estimates the echo density: an arrival at distance d of a
+ray out of N through a listener of radius r stands for 4 d^2 / (N r^2) image sources, so adding that up over a time
+window gives the reflections per second. The mixing time is the start of the first window where the density reaches
+echo_density. The decay rate is fitted to the energy decay curve (Schroeder integral) of the pilot after the mixing time.
+Both are properties of the room, so they are only estimated again when the static geometry changes. Moving objects are
+dynamic and don't trigger a new pilot.*/
+
+#include <vector>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+
+#define HYBRID_ECHO_DENSITY 1000.0f		//Reflections per second at the mixing time
+#define HYBRID_PILOT_FRACTION 0.1f		//Fraction of the rays cast for the pilot
+#define HYBRID_WINDOW 0.01f				//Echo density window (s)
+#define HYBRID_FIT_RANGE 30.0f			//dB of the decay curve used for the fit
+#define HYBRID_MATCH_LENGTH 0.01f		//Traced response averaged to set the level of the tail (s)
+
+class HybridReverb {
+public:
+	float echo_density;
+	float pilot_fraction;
+	//Estimated for the current geometry. If it isn't found nothing is synthesized.
+	float mixing_time;		//s
+	float decay_rate;		//dB/s, negative
+	bool found;
+	bool estimated;
+	unsigned int geometry_version;
+
+public:
+	HybridReverb(float echo_density, float pilot_fraction);
+	//Casts the pilot with rt (the settings of rt are restored afterwards) if the room hasn't been estimated yet, and limits
+	//the paths of rt to the mixing time.
+	void prepare(RayTracer * rt);
+	//Adds to rs (at sample_rate) the decay from the mixing time, continuing the level of the traced response before it
+	void render(std::vector<float> * rs, int sample_rate);
+	//Reverberation time (s) of the fitted decay
+	float reverberationTime();
+};
@@ -0,0 +1,281 @@
+#include "ImageSource.h"
+
+#include <random>
+#include <cmath>
+#include <set>
+
+ImageSourceTracer::ImageSourceTracer(Scene * scene, float source_power, int max_order, float reflexion_coef, int visibility_rays) {
+	this->scene = scene;
+	this->source_power = source_power;
+	this->max_order = max_order;
+	this->reflexion_coef = reflexion_coef;
+	this->visibility_rays = visibility_rays;
+	this->geometry_version = scene->geometry_version;
+}
+
+glm::vec3 mirrorPoint(glm::vec3 point, glm::vec3 * triangle) {
+	glm::vec3 normal = glm::normalize(glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]));
+	return point - 2.0f * glm::dot(point - triangle[0], normal) * normal;
+}
+
+bool segmentTriangleIntersection(glm::vec3 from, glm::vec3 to, glm::vec3 * triangle, glm::vec3 * intersection) {
+	//Moller-Trumbore, the segment is parametrized as from + t * (to - from) with t in (0, 1)
+	glm::vec3 dir = to - from;
+	glm::vec3 edge1 = triangle[1] - triangle[0];
+	glm::vec3 edge2 = triangle[2] - triangle[0];
+	glm::vec3 p = glm::cross(dir, edge2);
+	float det = glm::dot(edge1, p);
+	if (fabs(det) < 1e-12) {
+		return false;
+	}
+	float inv_det = 1.0f / det;
+	glm::vec3 s = from - triangle[0];
+	float u = glm::dot(s, p) * inv_det;
+	if (u < 0 || u > 1) {
+		return false;
+	}
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(dir, q) * inv_det;
+	if (v < 0 || u + v > 1) {
+		return false;
+	}
+	float t = glm::dot(edge2, q) * inv_det;
+	if (t <= 0 || t >= 1) {
+		return false;
+	}
+	*intersection = from + dir * t;
+	return true;
+}
+
+bool segmentPrimitiveIntersection(glm::vec3 from, glm::vec3 to, glm::vec3 * vertices, unsigned int count, glm::vec3 * intersection) {
+	if (segmentTriangleIntersection(from, to, vertices, intersection)) {
+		return true;
+	}
+	if (count < 4) {
+		return false;
+	}
+	//Quads are convex, so the second half is the other side of the 0-2 diagonal
+	glm::vec3 second_half[3] = { vertices[0], vertices[2], vertices[3] };
+	return segmentTriangleIntersection(from, to, second_half, intersection);
+}
+
+glm::vec3 samplePrimitive(glm::vec3 * vertices, unsigned int count, double r1, double r2, double r3) {
+	glm::vec3 a = vertices[0], b = vertices[1], c = vertices[2];
+	if (count == 4) {
+		//Pick one of the halves of the quad proportionally to its area
+		float area_first = glm::length(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
+		float area_second = glm::length(glm::cross(vertices[2] - vertices[0], vertices[3] - vertices[0]));
+		if (r3 * (area_first + area_second) >= area_first) {
+			b = vertices[2];
+			c = vertices[3];
+		}
+	}
+	double s = sqrt(r1);
+	return (float)(1 - s) * a + (float)(s * (1 - r2)) * b + (float)(s * r2) * c;
+}
+
+imageSourceTree * ImageSourceTracer::getTree(glm::vec3 source_pos) {
+	//The trees depend on the static reflectors' positions, so they are rebuilt if one of them moved
+	if (this->geometry_version != this->scene->geometry_version) {
+		clearCache();
+		this->geometry_version = this->scene->geometry_version;
+	}
+	std::tuple<int, int, int> key = std::make_tuple((int)round(source_pos.x * 1000), (int)round(source_pos.y * 1000), (int)round(source_pos.z * 1000));
+	auto it = this->cache.find(key);
+	if (it != this->cache.end()) {
+		return it->second;
+	}
+	if (this->cache.size() >= IMAGE_SOURCE_CACHE_SIZE) {
+		clearCache();
+	}
+	imageSourceTree * tree = new imageSourceTree();
+	tree->source_pos = source_pos;
+	buildTree(tree);
+	this->cache[key] = tree;
+	return tree;
+}
+
+void ImageSourceTracer::buildTree(imageSourceTree * tree) {
+	tree->images.clear();
+	imageSource root = { tree->source_pos, { RTC_INVALID_GEOMETRY_ID, RTC_INVALID_GEOMETRY_ID }, -1, 0 };
+	tree->images.push_back(root);
+
+	//Children are appended while iterating, so the loop visits the tree in breadth first order
+	for (size_t i = 0; i < tree->images.size(); i++) {
+		imageSource node = tree->images[i];
+		if (node.order >= this->max_order) {
+			continue;
+		}
+		std::vector<reflectorID> visible;
+		if (node.parent < 0) {
+			visibleReflectors(node.pos, NULL, 0, node.reflector, this->visibility_rays * IMAGE_SOURCE_ROOT_RAYS_FACTOR, &visible);
+		}
+		else {
+			glm::vec3 aperture[SCENE_MAX_PRIMITIVE_VERTICES];
+			unsigned int aperture_vertices = this->scene->getPrimitive(node.reflector.geomID, node.reflector.primID, aperture);
+			visibleReflectors(node.pos, aperture, aperture_vertices, node.reflector, this->visibility_rays, &visible);
+		}
+		for (int j = 0; j < visible.size(); j++) {
+			glm::vec3 triangle[3];
+			this->scene->getTriangle(visible[j].geomID, visible[j].primID, triangle);
+			imageSource child = { mirrorPoint(node.pos, triangle), visible[j], (int)i, node.order + 1 };
+			tree->images.push_back(child);
+		}
+	}
+}
+
+void ImageSourceTracer::visibleReflectors(glm::vec3 origin, glm::vec3 * aperture, unsigned int aperture_vertices, reflectorID exclude, int rays, std::vector<reflectorID> * visible) {
+	std::set<std::pair<unsigned int, unsigned int>> found;
+	//Fixed seed so the same source position always produces the same tree
+	std::mt19937 generator(rays);
+	std::uniform_real_distribution<double> uniform01(0.0, 1.0);
+
+	//Trees are cached while the static geometry doesn't change, so they are built without the dynamic objects
+	staticIntersectContext context;
+	this->scene->initStaticContext(&context);
+
+	for (int i = 0; i < rays; i++) {
+		glm::vec3 ray_origin, dir;
+		if (aperture) {
+			//Uniform point on the aperture. The ray continues from there in the image's direction, which is the reflected ray.
+			double r1 = uniform01(generator);
+			double r2 = uniform01(generator);
+			double r3 = aperture_vertices == 4 ? uniform01(generator) : 0;
+			glm::vec3 point = samplePrimitive(aperture, aperture_vertices, r1, r2, r3);
+			if (glm::length(point - origin) < 1e-6) {
+				continue;
+			}
+			dir = glm::normalize(point - origin);
+			ray_origin = point;
+		}
+		else {
+			double theta = 2 * M_PI * uniform01(generator);
+			double phi = acos(1 - 2 * uniform01(generator));
+			dir = glm::normalize(glm::vec3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)));
+			ray_origin = origin;
+		}
+
+		struct RTCRayHit rayhit;
+		rayhit.ray.org_x = ray_origin.x;
+		rayhit.ray.org_y = ray_origin.y;
+		rayhit.ray.org_z = ray_origin.z;
+		rayhit.ray.dir_x = dir.x;
+		rayhit.ray.dir_y = dir.y;
+		rayhit.ray.dir_z = dir.z;
+		rayhit.ray.tnear = aperture ? 0.001f : 0.0f;
+		rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+		rayhit.ray.mask = -1;
+		rayhit.ray.flags = 0;
+		rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+		rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+		rtcIntersect1(this->scene->getRTCScene(), &context.context, &rayhit);
+
+		unsigned int object = this->scene->hitObject(rayhit.hit);
+		if (object == RTC_INVALID_GEOMETRY_ID) {
+			continue;
+		}
+		if (object == exclude.geomID && rayhit.hit.primID == exclude.primID) {
+			continue;
+		}
+		if (found.insert(std::make_pair(object, rayhit.hit.primID)).second) {
+			visible->push_back({ object, rayhit.hit.primID });
+		}
+	}
+}
+
+bool isSegmentVisible(Scene * scene, glm::vec3 from, glm::vec3 to) {
+	float distance = glm::length(to - from);
+	if (distance < 0.002f) {
+		return true;
+	}
+	glm::vec3 dir = (to - from) / distance;
+
+	struct RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	struct RTCRay ray;
+	ray.org_x = from.x;
+	ray.org_y = from.y;
+	ray.org_z = from.z;
+	ray.dir_x = dir.x;
+	ray.dir_y = dir.y;
+	ray.dir_z = dir.z;
+	//Both ends can lie on reflectors, so we leave a small margin to not hit them
+	ray.tnear = 0.001f;
+	ray.tfar = distance - 0.001f;
+	ray.mask = -1;
+	ray.flags = 0;
+
+	rtcOccluded1(scene->getRTCScene(), &context, &ray);
+	//rtcOccluded1 sets tfar to -inf if an intersection is found
+	return ray.tfar >= 0;
+}
+
+bool isSpecularPathValid(Scene * scene, const std::vector<glm::vec3> & images, const reflectorSequence & reflectors, glm::vec3 listener_pos) {
+	//Walk the path backwards: the segment from the current point to the image crosses the image's reflector at the reflection point
+	glm::vec3 target = listener_pos;
+	for (int k = reflectors.size(); k > 0; k--) {
+		glm::vec3 reflector[SCENE_MAX_PRIMITIVE_VERTICES];
+		glm::vec3 reflection_point;
+		unsigned int count = scene->getPrimitive(reflectors[k - 1].geomID, reflectors[k - 1].primID, reflector);
+		if (!segmentPrimitiveIntersection(target, images[k], reflector, count, &reflection_point)) {
+			return false;
+		}
+		if (!isSegmentVisible(scene, target, reflection_point)) {
+			return false;
+		}
+		target = reflection_point;
+	}
+	return isSegmentVisible(scene, target, images[0]);
+}
+
+float specularPathEnergy(float source_power, float reflexion_coef, int order, float distance) {
+	return source_power * pow(reflexion_coef, order) / (4 * M_PI * pow(distance, 2));
+}
+
+bool ImageSourceTracer::validatePath(imageSourceTree * tree, int image_index, glm::vec3 listener_pos, audioPath * path) {
+	imageSource * node = &tree->images[image_index];
+	int order = node->order;
+	std::vector<glm::vec3> images(order + 1);
+	reflectorSequence reflectors(order);
+	for (int k = order; k >= 0; k--) {
+		images[k] = node->pos;
+		if (k > 0) {
+			reflectors[k - 1] = node->reflector;
+			node = &tree->images[node->parent];
+		}
+	}
+	if (!isSpecularPathValid(this->scene, images, reflectors, listener_pos)) {
+		return false;
+	}
+
+	//The length of the reflected path is the distance to the image
+	float distance = glm::length(listener_pos - images[order]);
+	path->travelled_distance = distance;
+	path->remaining_energy_factor = specularPathEnergy(this->source_power, this->reflexion_coef, order, distance);
+	path->is_direct_path = order == 0;
+	path->reflection_order = order;
+	return true;
+}
+
+void ImageSourceTracer::render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths) {
+	imageSourceTree * tree = getTree(source_pos);
+	for (int i = 0; i < tree->images.size(); i++) {
+		audioPath path;
+		if (validatePath(tree, i, listener_pos, &path)) {
+			addAudioPath(paths, path);
+		}
+	}
+}
+
+void ImageSourceTracer::clearCache() {
+	for (auto it = this->cache.begin(); it != this->cache.end(); ++it) {
+		delete(it->second);
+	}
+	this->cache.clear();
+}
+
+ImageSourceTracer::~ImageSourceTracer() {
+	clearCache();
+}
@@ -0,0 +1,90 @@
+#pragma once
+/*Image source method for the early reflections. Every reflector visible from the source (or from one of its images)
+generates a new image by mirroring the source across the reflector's plane. The images form a tree that only depends
+on the source position and the static geometry, so it is built once and cached. Dynamic objects only occlude its paths,
+their reflections are left to the ray tracer. For a given listener position each image is validated by
+walking the tree back to the source, checking that the path hits every reflector inside its triangle and that no
+segment is occluded.*/
+
+#include <embree3/rtcore.h>
+#include <embree3/rtcore_common.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+#include <tuple>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+
+//Rays used to sample the reflectors visible from each node of the tree. The root samples the whole sphere so it uses more.
+#define IMAGE_SOURCE_VISIBILITY_RAYS 256
+#define IMAGE_SOURCE_ROOT_RAYS_FACTOR 64
+//Maximum number of trees kept in cache. When it is full the cache is cleared.
+#define IMAGE_SOURCE_CACHE_SIZE 16
+
+typedef struct imageSource {
+	glm::vec3 pos;				//Source mirrored by every reflector from the root to this node
+	reflectorID reflector;		//Reflector that generated this image. Invalid for the root.
+	int parent;					//Index of the parent in the tree. -1 for the root (the real source).
+	int order;
+} imageSource;
+
+typedef struct imageSourceTree {
+	glm::vec3 source_pos;
+	//Images are stored in breadth first order so every parent comes before its children
+	std::vector<imageSource> images;
+} imageSourceTree;
+
+class ImageSourceTracer {
+public:
+	Scene * scene;
+	float source_power;
+	int max_order;
+	float reflexion_coef;
+	int visibility_rays;
+	//Trees are cached by source position (quantized to millimeters)
+	std::map<std::tuple<int, int, int>, imageSourceTree*> cache;
+	//Scene geometry version the cached trees were built for
+	unsigned int geometry_version;
+
+public:
+	ImageSourceTracer(Scene * scene, float source_power, int max_order, float reflexion_coef, int visibility_rays);
+
+	//Returns the cached tree for source_pos, building it if needed.
+	imageSourceTree * getTree(glm::vec3 source_pos);
+	void buildTree(imageSourceTree * tree);
+
+	//Reflectors hit by rays going from origin through the aperture primitive (or in every direction if aperture is NULL).
+	void visibleReflectors(glm::vec3 origin, glm::vec3 * aperture, unsigned int aperture_vertices, reflectorID exclude, int rays, std::vector<reflectorID> * visible);
+
+	//Computes the path from the source to listener_pos through image image_index. Returns false if the path is not valid.
+	bool validatePath(imageSourceTree * tree, int image_index, glm::vec3 listener_pos, audioPath * path);
+
+	//Adds to paths every valid image source path between source_pos and listener_pos.
+	void render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths);
+
+	void clearCache();
+	~ImageSourceTracer();
+};
+
+//Mirrors point across the plane that contains triangle
+glm::vec3 mirrorPoint(glm::vec3 point, glm::vec3 * triangle);
+
+//Intersects segment from-to with the plane of triangle. Returns false if the intersection is outside the segment or the triangle.
+bool segmentTriangleIntersection(glm::vec3 from, glm::vec3 to, glm::vec3 * triangle, glm::vec3 * intersection);
+
+//Same for a primitive with count vertices (a triangle or a convex quad)
+bool segmentPrimitiveIntersection(glm::vec3 from, glm::vec3 to, glm::vec3 * vertices, unsigned int count, glm::vec3 * intersection);
+
+//Uniform point on a primitive with count vertices from random numbers in [0, 1). r3 is only used by quads.
+glm::vec3 samplePrimitive(glm::vec3 * vertices, unsigned int count, double r1, double r2, double r3);
+
+//Returns true if segment from-to is not blocked by the scene
+bool isSegmentVisible(Scene * scene, glm::vec3 from, glm::vec3 to);
+
+/*images[0] is the source and images[k] is images[k-1] mirrored by reflectors[k-1]. Returns true if the specular path
+from the source to listener_pos through every reflector exists and is not occluded.*/
+bool isSpecularPathValid(Scene * scene, const std::vector<glm::vec3> & images, const reflectorSequence & reflectors, glm::vec3 listener_pos);
+
+//Energy of a specular path. Same value that the ray tracer converges to: the power spreads over a sphere of radius distance.
+float specularPathEnergy(float source_power, float reflexion_coef, int order, float distance);
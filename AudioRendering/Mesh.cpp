@@ -34,31 +34,40 @@ Mesh::Mesh(){
 	textured = false;
 }
 
-Mesh::Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, float * normals) {
+Mesh::Mesh(const std::vector<float> & vertices, const std::vector<unsigned int> & indices, const float * normals)
+	: Mesh(vertices.data(), vertices.size(), indices.data(), indices.size(), normals) {
+}
+
+Mesh::Mesh(const float * vertices, size_t vertex_floats, const unsigned int * indices, size_t index_count, const float * normals) {
 	glGenVertexArrays(1, &vaoID);
 	glBindVertexArray(vaoID);
 
 	glGenBuffers(1, &this->verticesID);
 	glBindBuffer(GL_ARRAY_BUFFER, this->verticesID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertex_floats * sizeof(float), vertices, GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
-	this->vertexCount = vertices.size();
+	this->vertexCount = vertex_floats;
 
 	glGenBuffers(1, &this->indicesID);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->indicesID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(unsigned int), indices, GL_STATIC_DRAW);
 
-	this->indexCount = indices.size();
+	this->indexCount = index_count;
 
 	glGenBuffers(1, &this->normalsID);
 	glBindBuffer(GL_ARRAY_BUFFER, this->normalsID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), normals, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertex_floats * sizeof(float), normals, GL_STATIC_DRAW);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
 
 	textured = false;
 }
 
+size_t Mesh::getByteSize() {
+	//Positions and normals have the same size
+	return (size_t)this->vertexCount * 2 * sizeof(float) + (size_t)this->indexCount * sizeof(unsigned int);
+}
+
 void Mesh::draw() {
 	glBindVertexArray(vaoID);
 	//El 0 indica que es el primer parametro del "in" del shader, el 1 el siguiente, etc
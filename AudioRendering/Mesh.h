@@ -13,10 +13,14 @@ public:
 	unsigned int vertexCount, indexCount;
 public:
 	Mesh();
-	Mesh(std::vector<float> vertices, std::vector<unsigned int> indices, float * normals);
+	Mesh(const std::vector<float> & vertices, const std::vector<unsigned int> & indices, const float * normals);
+	//vertex_floats is 3 times the number of vertices. The data is only read during the upload.
+	Mesh(const float * vertices, size_t vertex_floats, const unsigned int * indices, size_t index_count, const float * normals);
 	void setShader(GLuint shaderID); //No se si poner un puntero al shader que usa
 	void draw();
 	void addTexture(std::vector<float> textcoords);
+	//Bytes uploaded to the GPU for the vertices, normals and indices
+	size_t getByteSize();
 	~Mesh();
 };
 
@@ -0,0 +1,328 @@
+#include "MeshSimplifier.h"
+
+#include <map>
+#include <set>
+#include <queue>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+typedef struct edgeCollapse {
+	double cost;
+	unsigned int v1, v2;
+	unsigned int version1, version2;	//Versions of the vertices when the collapse was computed
+	glm::dvec3 target;
+} edgeCollapse;
+
+struct edgeCollapseOrder {
+	bool operator()(const edgeCollapse & a, const edgeCollapse & b) const {
+		return a.cost > b.cost;
+	}
+};
+
+//Mesh being simplified
+typedef struct simplificationMesh {
+	std::vector<glm::dvec3> vertices;
+	std::vector<glm::uvec3> triangles;
+	std::vector<bool> alive;						//Per triangle
+	std::vector<std::vector<unsigned int>> vertex_triangles;
+	std::vector<glm::dmat4> quadrics;
+	std::vector<unsigned int> versions;
+	std::vector<bool> removed;						//Per vertex
+} simplificationMesh;
+
+static glm::dvec3 triangleCross(const simplificationMesh & mesh, glm::uvec3 t) {
+	return glm::cross(mesh.vertices[t.y] - mesh.vertices[t.x], mesh.vertices[t.z] - mesh.vertices[t.x]);
+}
+
+static glm::dmat4 planeQuadric(glm::dvec3 normal, glm::dvec3 point, double weight) {
+	glm::dvec4 plane = glm::dvec4(normal, -glm::dot(normal, point));
+	return weight * glm::outerProduct(plane, plane);
+}
+
+static double quadricError(const glm::dmat4 & q, glm::dvec3 v) {
+	glm::dvec4 p = glm::dvec4(v, 1.0);
+	return glm::dot(p, q * p);
+}
+
+static edgeCollapse computeCollapse(const simplificationMesh & mesh, unsigned int v1, unsigned int v2) {
+	glm::dmat4 q = mesh.quadrics[v1] + mesh.quadrics[v2];
+	edgeCollapse collapse;
+	collapse.v1 = v1;
+	collapse.v2 = v2;
+	collapse.version1 = mesh.versions[v1];
+	collapse.version2 = mesh.versions[v2];
+	//Optimal position minimizes the error: solve the 3x3 system of the quadric's derivative
+	glm::dmat3 a = glm::dmat3(q);
+	glm::dvec3 b = glm::dvec3(q[3]);
+	if (fabs(glm::determinant(a)) > 1e-12) {
+		collapse.target = -(glm::inverse(a) * b);
+		collapse.cost = quadricError(q, collapse.target);
+	}
+	else {
+		//Singular (e.g. flat region): keep the best of the end points and the midpoint
+		glm::dvec3 candidates[3] = { mesh.vertices[v1], mesh.vertices[v2], (mesh.vertices[v1] + mesh.vertices[v2]) * 0.5 };
+		collapse.cost = std::numeric_limits<double>::infinity();
+		for (int i = 0; i < 3; i++) {
+			double error = quadricError(q, candidates[i]);
+			if (error < collapse.cost) {
+				collapse.cost = error;
+				collapse.target = candidates[i];
+			}
+		}
+	}
+	return collapse;
+}
+
+static void neighbors(const simplificationMesh & mesh, unsigned int v, std::set<unsigned int> * result) {
+	for (unsigned int t : mesh.vertex_triangles[v]) {
+		if (!mesh.alive[t]) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			if (mesh.triangles[t][k] != v) {
+				result->insert(mesh.triangles[t][k]);
+			}
+		}
+	}
+}
+
+static bool isCollapseValid(const simplificationMesh & mesh, const edgeCollapse & collapse) {
+	//Link condition: the end points can only share the vertices opposite to the edge, otherwise the mesh stops being manifold
+	std::set<unsigned int> n1, n2;
+	neighbors(mesh, collapse.v1, &n1);
+	neighbors(mesh, collapse.v2, &n2);
+	int common = 0;
+	for (unsigned int v : n1) {
+		common += n2.count(v);
+	}
+	int shared = 0;
+	for (unsigned int t : mesh.vertex_triangles[collapse.v1]) {
+		if (!mesh.alive[t]) {
+			continue;
+		}
+		glm::uvec3 tri = mesh.triangles[t];
+		if (tri.x == collapse.v2 || tri.y == collapse.v2 || tri.z == collapse.v2) {
+			shared++;
+		}
+	}
+	if (common != shared) {
+		return false;
+	}
+
+	//No remaining triangle can flip or degenerate
+	unsigned int ends[2] = { collapse.v1, collapse.v2 };
+	for (int e = 0; e < 2; e++) {
+		for (unsigned int t : mesh.vertex_triangles[ends[e]]) {
+			if (!mesh.alive[t]) {
+				continue;
+			}
+			glm::uvec3 tri = mesh.triangles[t];
+			bool has_other = tri.x == ends[1 - e] || tri.y == ends[1 - e] || tri.z == ends[1 - e];
+			if (has_other) {
+				continue;
+			}
+			glm::dvec3 before = triangleCross(mesh, tri);
+			glm::dvec3 p[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = tri[k] == ends[e] ? collapse.target : mesh.vertices[tri[k]];
+			}
+			glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			double before_length = glm::length(before);
+			double after_length = glm::length(after);
+			if (after_length < 1e-12 || glm::dot(before, after) < SIMPLIFY_MAX_NORMAL_CHANGE * before_length * after_length) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+simplificationStats simplifyMesh(OBJProperites * props, double tolerance) {
+	//The simplification works on triangles, so the quads are split and the result is a triangle mesh
+	if (props->quads) {
+		props->indices = triangulateQuads(props->indices.data(), props->indices.size() / 4);
+		props->quads = false;
+	}
+	simplificationStats stats = { (unsigned int)(props->indices.size() / 3), 0, 0, 0, 0, 0 };
+	unsigned int input_vertices = props->vertices.size() / 3;
+
+	//WELD ---------------------------------------------------------------------------
+	//Vertices are snapped to a grid and the ones in the same cell become a single vertex
+	double cell = tolerance * SIMPLIFY_WELD_FRACTION;
+	std::map<std::tuple<long long, long long, long long>, unsigned int> cells;
+	std::vector<unsigned int> weld(input_vertices);
+	std::vector<unsigned int> representative;		//Original vertex of each welded vertex
+	simplificationMesh mesh;
+	for (unsigned int i = 0; i < input_vertices; i++) {
+		glm::dvec3 v = glm::dvec3(props->vertices[i * 3], props->vertices[i * 3 + 1], props->vertices[i * 3 + 2]);
+		auto key = std::make_tuple((long long)floor(v.x / cell), (long long)floor(v.y / cell), (long long)floor(v.z / cell));
+		auto it = cells.find(key);
+		if (it != cells.end()) {
+			weld[i] = it->second;
+			stats.welded_vertices++;
+		}
+		else {
+			weld[i] = mesh.vertices.size();
+			cells[key] = weld[i];
+			mesh.vertices.push_back(v);
+			representative.push_back(i);
+		}
+	}
+
+	//CLEAN --------------------------------------------------------------------------
+	double tiny_area = tolerance * tolerance * SIMPLIFY_TINY_AREA_FRACTION;
+	for (size_t i = 0; i + 2 < props->indices.size(); i += 3) {
+		glm::uvec3 t = glm::uvec3(weld[props->indices[i]], weld[props->indices[i + 1]], weld[props->indices[i + 2]]);
+		if (t.x == t.y || t.y == t.z || t.x == t.z) {
+			stats.degenerate_triangles++;
+			continue;
+		}
+		double area = glm::length(triangleCross(mesh, t)) / 2;
+		if (area == 0) {
+			stats.degenerate_triangles++;
+			continue;
+		}
+		if (area < tiny_area) {
+			stats.tiny_triangles++;
+			continue;
+		}
+		mesh.triangles.push_back(t);
+	}
+
+	//QUADRICS -----------------------------------------------------------------------
+	unsigned int num_vertices = mesh.vertices.size();
+	mesh.alive.assign(mesh.triangles.size(), true);
+	mesh.vertex_triangles.resize(num_vertices);
+	mesh.quadrics.assign(num_vertices, glm::dmat4(0.0));
+	mesh.versions.assign(num_vertices, 0);
+	mesh.removed.assign(num_vertices, false);
+	std::map<std::pair<unsigned int, unsigned int>, int> edge_uses;
+	for (unsigned int t = 0; t < mesh.triangles.size(); t++) {
+		glm::uvec3 tri = mesh.triangles[t];
+		glm::dvec3 normal = glm::normalize(triangleCross(mesh, tri));
+		for (int k = 0; k < 3; k++) {
+			mesh.vertex_triangles[tri[k]].push_back(t);
+			mesh.quadrics[tri[k]] += planeQuadric(normal, mesh.vertices[tri.x], 1.0);
+			unsigned int a = tri[k], b = tri[(k + 1) % 3];
+			edge_uses[std::make_pair(glm::min(a, b), glm::max(a, b))]++;
+		}
+	}
+	//Boundary edges get a plane perpendicular to their triangle, so the collapses don't move the boundary
+	for (unsigned int t = 0; t < mesh.triangles.size(); t++) {
+		glm::uvec3 tri = mesh.triangles[t];
+		glm::dvec3 normal = glm::normalize(triangleCross(mesh, tri));
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = tri[k], b = tri[(k + 1) % 3];
+			if (edge_uses[std::make_pair(glm::min(a, b), glm::max(a, b))] != 1) {
+				continue;
+			}
+			glm::dvec3 edge = mesh.vertices[b] - mesh.vertices[a];
+			glm::dvec3 constraint = glm::cross(edge, normal);
+			if (glm::length(constraint) < 1e-12) {
+				continue;
+			}
+			glm::dmat4 q = planeQuadric(glm::normalize(constraint), mesh.vertices[a], SIMPLIFY_BOUNDARY_WEIGHT);
+			mesh.quadrics[a] += q;
+			mesh.quadrics[b] += q;
+		}
+	}
+
+	//DECIMATION ---------------------------------------------------------------------
+	std::priority_queue<edgeCollapse, std::vector<edgeCollapse>, edgeCollapseOrder> queue;
+	for (auto it = edge_uses.begin(); it != edge_uses.end(); ++it) {
+		queue.push(computeCollapse(mesh, it->first.first, it->first.second));
+	}
+	double max_error = tolerance * tolerance;
+	while (!queue.empty()) {
+		edgeCollapse collapse = queue.top();
+		queue.pop();
+		if (collapse.cost > max_error) {
+			break;
+		}
+		//Skip collapses computed before one of the vertices changed
+		if (mesh.removed[collapse.v1] || mesh.removed[collapse.v2]
+			|| collapse.version1 != mesh.versions[collapse.v1] || collapse.version2 != mesh.versions[collapse.v2]) {
+			continue;
+		}
+		if (!isCollapseValid(mesh, collapse)) {
+			continue;
+		}
+		//v2 is merged into v1
+		unsigned int v1 = collapse.v1, v2 = collapse.v2;
+		for (unsigned int t : mesh.vertex_triangles[v2]) {
+			if (!mesh.alive[t]) {
+				continue;
+			}
+			glm::uvec3 & tri = mesh.triangles[t];
+			if (tri.x == v1 || tri.y == v1 || tri.z == v1) {
+				mesh.alive[t] = false;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == v2) {
+					tri[k] = v1;
+				}
+			}
+			mesh.vertex_triangles[v1].push_back(t);
+		}
+		mesh.vertex_triangles[v2].clear();
+		mesh.removed[v2] = true;
+		mesh.vertices[v1] = collapse.target;
+		mesh.quadrics[v1] += mesh.quadrics[v2];
+		mesh.versions[v1]++;
+		stats.collapsed_edges++;
+
+		//Drop the dead triangles from the list and queue the new edges of v1
+		std::vector<unsigned int> & triangles = mesh.vertex_triangles[v1];
+		triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [&mesh](unsigned int t) { return !mesh.alive[t]; }), triangles.end());
+		//The cost of the other edges only depends on their end points' quadrics, so they stay valid
+		std::set<unsigned int> adjacent;
+		neighbors(mesh, v1, &adjacent);
+		for (unsigned int v : adjacent) {
+			queue.push(computeCollapse(mesh, v1, v));
+		}
+	}
+
+	//OUTPUT -------------------------------------------------------------------------
+	std::vector<int> remap(num_vertices, -1);
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> kept;
+	for (unsigned int t = 0; t < mesh.triangles.size(); t++) {
+		if (!mesh.alive[t]) {
+			continue;
+		}
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = mesh.triangles[t][k];
+			if (remap[v] < 0) {
+				remap[v] = kept.size();
+				kept.push_back(v);
+				vertices.push_back((float)mesh.vertices[v].x);
+				vertices.push_back((float)mesh.vertices[v].y);
+				vertices.push_back((float)mesh.vertices[v].z);
+			}
+			indices.push_back(remap[v]);
+		}
+	}
+	std::vector<float> normals(vertices.size());
+	for (unsigned int i = 0; i < kept.size(); i++) {
+		unsigned int original = representative[kept[i]];
+		for (int k = 0; k < 3; k++) {
+			normals[i * 3 + k] = props->normals[original * 3 + k];
+		}
+	}
+	props->vertices = vertices;
+	props->indices = indices;
+	props->normals = normals;
+	stats.output_triangles = indices.size() / 3;
+	return stats;
+}
+
+void printSimplificationStats(std::string name, simplificationStats stats) {
+	std::cout << "Simplified " << name << ": " << stats.input_triangles << " -> " << stats.output_triangles << " triangles ("
+		<< 100.0f * (stats.input_triangles - stats.output_triangles) / glm::max(stats.input_triangles, 1u) << "% less). "
+		<< stats.welded_vertices << " vertices welded, " << stats.degenerate_triangles << " degenerate and "
+		<< stats.tiny_triangles << " tiny triangles dropped, " << stats.collapsed_edges << " edges collapsed." << std::endl;
+}
@@ -0,0 +1,36 @@
+#pragma once
+/*Acoustic mesh simplification. Details much smaller than the wavelengths of interest don't change the response but
+add triangles to the BVH. After loading, the mesh is cleaned and decimated up to a geometric tolerance:
+  - Vertices closer than a fraction of the tolerance are welded.
+  - Degenerate triangles (repeated vertices or no area) and tiny slivers are dropped.
+  - Edges are collapsed in order of quadric error (Garland-Heckbert) while the squared distance to the original
+    planes stays below tolerance^2. Boundary edges are kept in place with perpendicular constraint planes and
+    collapses that flip a triangle or break the manifold are rejected.*/
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "OBJLoader.h"
+
+//Vertices closer than tolerance * this are welded
+#define SIMPLIFY_WELD_FRACTION 0.01
+//Triangles with less area than (tolerance^2) * this are dropped
+#define SIMPLIFY_TINY_AREA_FRACTION 0.01
+//Weight of the boundary constraint planes relative to the face planes
+#define SIMPLIFY_BOUNDARY_WEIGHT 1000.0
+//A collapse is rejected if it rotates a triangle's normal more than this (cosine)
+#define SIMPLIFY_MAX_NORMAL_CHANGE 0.2
+
+typedef struct simplificationStats {
+	unsigned int input_triangles;
+	unsigned int welded_vertices;
+	unsigned int degenerate_triangles;
+	unsigned int tiny_triangles;
+	unsigned int collapsed_edges;
+	unsigned int output_triangles;
+} simplificationStats;
+
+//Simplifies the mesh in props in place with the given tolerance (in the mesh's units)
+simplificationStats simplifyMesh(OBJProperites * props, double tolerance);
+
+void printSimplificationStats(std::string name, simplificationStats stats);
@@ -1,52 +1,137 @@
 #include "OBJLoader.h"
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <glm/glm.hpp>
 
-OBJProperites loadOBJ(std::string file_name) {
+//Returns true if quad (indices in vertices) is planar and strictly convex, so it can be a single primitive
+static bool isPlanarConvexQuad(const std::vector<float> & vertices, const unsigned int * quad) {
+	glm::vec3 p[4];
+	for (int k = 0; k < 4; k++) {
+		p[k] = glm::vec3(vertices[quad[k] * 3], vertices[quad[k] * 3 + 1], vertices[quad[k] * 3 + 2]);
+	}
+	glm::vec3 normal = glm::cross(p[2] - p[0], p[3] - p[1]);
+	float diagonal = std::max(glm::length(p[2] - p[0]), glm::length(p[3] - p[1]));
+	if (glm::length(normal) <= 0) {
+		return false;
+	}
+	normal = glm::normalize(normal);
+	glm::vec3 center = (p[0] + p[1] + p[2] + p[3]) / 4.0f;
+	for (int k = 0; k < 4; k++) {
+		if (fabs(glm::dot(p[k] - center, normal)) > OBJ_QUAD_PLANARITY_TOLERANCE * diagonal) {
+			return false;
+		}
+		//Every corner has to turn in the same direction
+		if (glm::dot(glm::cross(p[(k + 1) % 4] - p[k], p[(k + 2) % 4] - p[(k + 1) % 4]), normal) <= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<unsigned int> triangulateQuads(const unsigned int * indices, size_t face_count) {
+	std::vector<unsigned int> triangles;
+	triangles.reserve(face_count * 6);
+	for (size_t f = 0; f < face_count; f++) {
+		const unsigned int * face = &indices[f * 4];
+		triangles.push_back(face[0]);
+		triangles.push_back(face[1]);
+		triangles.push_back(face[3]);
+		//Triangles repeat their last vertex, so the second half is empty
+		if (face[2] != face[3]) {
+			triangles.push_back(face[2]);
+			triangles.push_back(face[3]);
+			triangles.push_back(face[1]);
+		}
+	}
+	return triangles;
+}
+
+OBJProperites loadOBJ(std::string file_name, size_t * parse_bytes) {
 	tinyobj::ObjReader reader = tinyobj::ObjReader();
-	bool res = reader.ParseFromFile(file_name);
+	//tinyobj doesn't triangulate so the quads survive. Planar convex quads are kept and the rest of the faces are fan
+	//triangulated below. triangulateQuads is only used to upload quad meshes to GL.
+	tinyobj::ObjReaderConfig config;
+	config.triangulate = false;
+	bool res = reader.ParseFromFile(file_name, config);
 
 	//VERTICES -----------------------------------------------------------------------
 
-	std::vector<float> obj_vertices = reader.GetAttrib().GetVertices();
+	//The reader's data is only read, so it is referenced instead of copied
+	const std::vector<float> & obj_vertices = reader.GetAttrib().GetVertices();
 
 	//INDICES ------------------------------------------------------------------------
 
-	std::vector<tinyobj::shape_t> shapes = reader.GetShapes();
+	const std::vector<tinyobj::shape_t> & shapes = reader.GetShapes();
 
 	size_t shape_offset = 0;
-	std::vector<unsigned int> obj_indices;
+	//4 indices per face, triangles repeat their last vertex
+	std::vector<unsigned int> face_indices;
+	std::vector<unsigned int> corner_indices;
 	std::vector<unsigned int> normal_indices;
+	std::vector<unsigned int> face;
+	size_t quad_count = 0;
 	for (size_t s = 0; s < shapes.size(); s++) {
 		size_t face_offset = 0;
 		//for each face in mesh
 		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 			int fv = shapes[s].mesh.num_face_vertices[f];
-			//for each vertex in face. Number of vertices per face is given by obj file,
-			//but if triangulate is specified in reader config then is set to 3 everywhere. 
+			//for each vertex in face. Number of vertices per face is given by obj file.
+			face.clear();
 			for (size_t v = 0; v < fv; v++) {
 				//idx is the index in the vertices array
 				tinyobj::index_t idx = shapes[s].mesh.indices[face_offset + v];
-				obj_indices.push_back((unsigned int)idx.vertex_index);
-				//indices[shape_offset + face_offset + v] = idx.vertex_index;
+				face.push_back((unsigned int)idx.vertex_index);
+				corner_indices.push_back((unsigned int)idx.vertex_index);
 				normal_indices.push_back((unsigned int)idx.normal_index);
 			}
+			if (fv == 4 && isPlanarConvexQuad(obj_vertices, face.data())) {
+				face_indices.insert(face_indices.end(), face.begin(), face.end());
+				quad_count++;
+			}
+			else {
+				//Fan triangulation of the rest of the faces
+				for (size_t v = 2; v < fv; v++) {
+					face_indices.push_back(face[0]);
+					face_indices.push_back(face[v - 1]);
+					face_indices.push_back(face[v]);
+					face_indices.push_back(face[v]);
+				}
+			}
 			face_offset += fv;
 		}
 		shape_offset += face_offset;
 	}
 
+	//Without quads the mesh is kept as a plain triangle mesh
+	std::vector<unsigned int> obj_indices;
+	if (quad_count > 0) {
+		obj_indices.swap(face_indices);
+	}
+	else {
+		obj_indices.reserve(face_indices.size() / 4 * 3);
+		for (size_t i = 0; i < face_indices.size(); i += 4) {
+			obj_indices.insert(obj_indices.end(), face_indices.begin() + i, face_indices.begin() + i + 3);
+		}
+	}
+
 	//NORMALS ------------------------------------------------------------------------
 	/*Embree calculates normals for triangle meshes, so there is no need to create a normal buffer.
 	Normals follow right hand rule from vertex order.*/
 
-	std::vector<float> obj_normals = reader.GetAttrib().normals;
+	const std::vector<float> & obj_normals = reader.GetAttrib().normals;
 	/*OBJs have different indices for vertices, UVs and normals.
 	We need to create a new normal vector that stores the normal for vector[i] in the i position*/
 	//Note this method is inneficient since it writes the same memory more than one time in some cases.
-	float * all_normals = new float[obj_vertices.size()];
+	std::vector<float> all_normals(obj_vertices.size(), 0.0f);
 	for (int i = 0; i < normal_indices.size(); ++i) {
-		unsigned int vertex_index = obj_indices[i];
+		unsigned int vertex_index = corner_indices[i];
 		unsigned int normal_index = normal_indices[i];
+		//Faces without normals have index -1
+		if (normal_index * 3 + 2 >= obj_normals.size()) {
+			continue;
+		}
 
 		all_normals[vertex_index * 3] = obj_normals[normal_index * 3];
 		all_normals[vertex_index * 3 + 1] = obj_normals[normal_index * 3 + 1];
@@ -57,5 +142,124 @@ OBJProperites loadOBJ(std::string file_name) {
 		//	sizeof(float) * 3);
 	}
 
-	return { obj_vertices, obj_indices, all_normals };
+	if (parse_bytes) {
+		size_t shape_bytes = 0;
+		for (size_t s = 0; s < shapes.size(); s++) {
+			shape_bytes += shapes[s].mesh.indices.size() * sizeof(tinyobj::index_t) + shapes[s].mesh.num_face_vertices.size();
+		}
+		const tinyobj::attrib_t & attrib = reader.GetAttrib();
+		*parse_bytes = (attrib.vertices.size() + attrib.normals.size() + attrib.texcoords.size() + attrib.colors.size()) * sizeof(float)
+			+ shape_bytes + (obj_vertices.size() + all_normals.size()) * sizeof(float)
+			+ (obj_indices.size() + face_indices.capacity() + corner_indices.size() + normal_indices.size()) * sizeof(unsigned int);
+	}
+
+	return { obj_vertices, obj_indices, quad_count > 0, all_normals };
+}
+
+//Returns the first non blank character of line
+static const char * skipBlanks(const char * line) {
+	while (*line == ' ' || *line == '\t') {
+		line++;
+	}
+	return line;
+}
+
+/*Reads the vertex indices of face line (without the "f") into face. OBJ indices start at 1 and negative ones are
+relative to the vertices read so far.*/
+static void parseFace(const char * line, size_t read_vertices, std::vector<unsigned int> * face) {
+	face->clear();
+	const char * c = skipBlanks(line);
+	while (*c != '\0' && *c != '\r' && *c != '\n') {
+		char * end;
+		long index = strtol(c, &end, 10);
+		if (end == c) {
+			break;
+		}
+		face->push_back((unsigned int)(index < 0 ? (long)read_vertices + index : index - 1));
+		//Skip the texture and normal indices
+		c = end;
+		while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r' && *c != '\n') {
+			c++;
+		}
+		c = skipBlanks(c);
+	}
+}
+
+bool countOBJ(std::string file_name, size_t * vertex_count, size_t * triangle_count) {
+	*vertex_count = 0;
+	*triangle_count = 0;
+	std::ifstream file(file_name);
+	if (!file.is_open()) {
+		std::cout << "Error opening " << file_name << std::endl;
+		return false;
+	}
+	std::string line;
+	std::vector<unsigned int> face;
+	while (std::getline(file, line)) {
+		const char * c = skipBlanks(line.c_str());
+		if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+			(*vertex_count)++;
+		}
+		else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+			parseFace(c + 1, *vertex_count, &face);
+			if (face.size() >= 3) {
+				*triangle_count += face.size() - 2;
+			}
+		}
+	}
+	return true;
+}
+
+bool streamOBJ(std::string file_name, size_t vertex_count, size_t triangle_count, float * vertices, unsigned int * indices) {
+	//Whatever the file has, the buffers end up fully initialized
+	std::fill(vertices, vertices + vertex_count * 3, 0.0f);
+	std::fill(indices, indices + triangle_count * 3, 0u);
+	std::ifstream file(file_name);
+	if (!file.is_open()) {
+		std::cout << "Error opening " << file_name << std::endl;
+		return false;
+	}
+	std::string line;
+	std::vector<unsigned int> face;
+	size_t read_vertices = 0;
+	size_t read_triangles = 0;
+	size_t invalid_faces = 0;
+	while (std::getline(file, line)) {
+		const char * c = skipBlanks(line.c_str());
+		if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+			if (read_vertices < vertex_count) {
+				char * end = (char*)c + 1;
+				for (int k = 0; k < 3; k++) {
+					vertices[read_vertices * 3 + k] = strtof(end, &end);
+				}
+			}
+			read_vertices++;
+		}
+		else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+			parseFace(c + 1, read_vertices, &face);
+			bool valid = true;
+			for (size_t k = 0; k < face.size(); k++) {
+				valid = valid && face[k] < vertex_count;
+			}
+			if (!valid) {
+				invalid_faces++;
+			}
+			//Fan triangulation, same as tinyobj does for convex polygons. Invalid faces keep their degenerate triangles.
+			for (size_t k = 2; k < face.size(); k++) {
+				if (valid && read_triangles < triangle_count) {
+					indices[read_triangles * 3] = face[0];
+					indices[read_triangles * 3 + 1] = face[k - 1];
+					indices[read_triangles * 3 + 2] = face[k];
+				}
+				read_triangles++;
+			}
+		}
+	}
+	if (invalid_faces > 0) {
+		std::cout << file_name << ": " << invalid_faces << " faces reference vertices that don't exist" << std::endl;
+	}
+	if (read_vertices != vertex_count || read_triangles != triangle_count) {
+		std::cout << file_name << " changed while it was being read" << std::endl;
+	}
+	return invalid_faces == 0 && read_vertices == vertex_count && read_triangles == triangle_count;
 }
\ No newline at end of file
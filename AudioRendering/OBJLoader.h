@@ -2,10 +2,31 @@
 
 #include "tiny_obj_loader.h"
 
+//Maximum distance of a quad's vertices to its plane, relative to its longest diagonal, to keep it as a quad
+#define OBJ_QUAD_PLANARITY_TOLERANCE 1e-4f
+
 typedef struct OBJProperites {
 	std::vector<float> vertices;
+	/*3 indices per triangle, or 4 per face if quads is set. In that case triangles repeat their last vertex, which is
+	how embree stores triangles in a quad mesh.*/
 	std::vector<unsigned int> indices;
-	float * normals;
+	bool quads;
+	//Normal of vertex i in positions i * 3 to i * 3 + 2
+	std::vector<float> normals;
 }OBJProperites;
 
-OBJProperites loadOBJ(std::string file_name);
\ No newline at end of file
+/*Planar convex quads are kept as quads and the rest of the faces are triangulated. If parse_bytes is given it is set to
+the memory used while parsing (tinyobj's data plus the returned mesh).*/
+OBJProperites loadOBJ(std::string file_name, size_t * parse_bytes = NULL);
+
+//Triangle indices of face_count faces with 4 indices each. Quads are split in (0, 1, 3) and (2, 3, 1), as embree does.
+std::vector<unsigned int> triangulateQuads(const unsigned int * indices, size_t face_count);
+
+/*Streaming loader for meshes too big to hold more than one copy in memory. The file is read twice line by line:
+countOBJ gives the sizes of the buffers and streamOBJ fills them, so the caller can parse straight into its final
+storage. Only positions and faces are read, faces are fan triangulated.*/
+bool countOBJ(std::string file_name, size_t * vertex_count, size_t * triangle_count);
+/*vertices and indices have room for the vertex_count and triangle_count given by countOBJ, and are always filled
+without writing past them. Returns false if the file can't be read, if a face references a vertex that doesn't exist
+(the triangle is left degenerate) or if the file no longer matches the counts.*/
+bool streamOBJ(std::string file_name, size_t vertex_count, size_t triangle_count, float * vertices, unsigned int * indices);
\ No newline at end of file
@@ -0,0 +1,174 @@
+#define _USE_MATH_DEFINES
+#include "PathGuide.h"
+
+#include <cmath>
+#include <algorithm>
+
+glm::vec2 directionToSquare(glm::vec3 dir) {
+	float u = (glm::clamp(dir.z, -1.0f, 1.0f) + 1) / 2;
+	float v = atan2(dir.y, dir.x) / (2 * M_PI);
+	if (v < 0) {
+		v += 1;
+	}
+	return glm::vec2(glm::clamp(u, 0.0f, 0.999999f), glm::clamp(v, 0.0f, 0.999999f));
+}
+
+glm::vec3 squareToDirection(glm::vec2 square) {
+	float z = 2 * square.x - 1;
+	float r = sqrt(glm::max(0.0f, 1 - z * z));
+	float phi = 2 * M_PI * square.y;
+	return glm::vec3(r * cos(phi), r * sin(phi), z);
+}
+
+PathGuide::PathGuide(int iterations) : PathGuide(iterations, PATH_GUIDE_MAX_DEPTH, PATH_GUIDE_SUBDIVISION_THRESHOLD, PATH_GUIDE_UNIFORM_FRACTION) {
+}
+
+PathGuide::PathGuide(int iterations, int max_depth, float subdivision_threshold, float uniform_fraction) {
+	//At least one iteration is needed to cast any ray
+	this->iterations = std::max(iterations, 1);
+	this->max_depth = max_depth;
+	this->subdivision_threshold = subdivision_threshold;
+	this->uniform_fraction = uniform_fraction;
+	reset();
+}
+
+glm::vec3 PathGuide::sample(double u1, double u2, double u3, float * pdf) {
+	glm::vec2 square;
+	if (!this->trained || u1 < this->uniform_fraction) {
+		square = glm::vec2(u2, u3);
+	}
+	else {
+		//Descend the tree choosing each child proportionally to its weight. The random numbers are rescaled
+		//at every level so they can be reused to pick the point inside the leaf.
+		glm::vec2 origin(0, 0);
+		float extent = 1;
+		int node = 0;
+		while (this->nodes[node].children >= 0) {
+			int first = this->nodes[node].children;
+			float weights[4];
+			float total = 0;
+			for (int c = 0; c < 4; c++) {
+				weights[c] = this->nodes[first + c].sample_weight;
+				total += weights[c];
+			}
+			//Child c covers the quadrant (c % 2, c / 2). First choose the column, then the row.
+			float left = weights[0] + weights[2];
+			float p_left = total > 0 ? left / total : 0.5f;
+			int column, row;
+			if (u2 < p_left) {
+				column = 0;
+				u2 = u2 / p_left;
+			}
+			else {
+				column = 1;
+				u2 = (u2 - p_left) / (1 - p_left);
+			}
+			float column_total = weights[column] + weights[column + 2];
+			float p_top = column_total > 0 ? weights[column] / column_total : 0.5f;
+			if (u3 < p_top) {
+				row = 0;
+				u3 = u3 / p_top;
+			}
+			else {
+				row = 1;
+				u3 = (u3 - p_top) / (1 - p_top);
+			}
+			extent /= 2;
+			origin += glm::vec2(column * extent, row * extent);
+			node = first + column + 2 * row;
+		}
+		square = origin + glm::vec2(u2, u3) * extent;
+	}
+	glm::vec3 dir = squareToDirection(square);
+	*pdf = this->pdf(dir);
+	return dir;
+}
+
+float PathGuide::pdf(glm::vec3 dir) {
+	if (!this->trained) {
+		return 1;
+	}
+	glm::vec2 square = directionToSquare(dir);
+	float tree_pdf = 1;
+	int node = 0;
+	while (this->nodes[node].children >= 0) {
+		int first = this->nodes[node].children;
+		float total = 0;
+		for (int c = 0; c < 4; c++) {
+			total += this->nodes[first + c].sample_weight;
+		}
+		int column = square.x >= 0.5f ? 1 : 0;
+		int row = square.y >= 0.5f ? 1 : 0;
+		int child = first + column + 2 * row;
+		//Each quadrant covers a quarter of the area
+		tree_pdf *= total > 0 ? 4 * this->nodes[child].sample_weight / total : 1;
+		square = glm::vec2(square.x * 2 - column, square.y * 2 - row);
+		node = child;
+	}
+	return this->uniform_fraction + (1 - this->uniform_fraction) * tree_pdf;
+}
+
+void PathGuide::record(glm::vec3 dir, float energy) {
+	if (energy <= 0) {
+		return;
+	}
+	glm::vec2 square = directionToSquare(dir);
+	this->mutex.lock();
+	int node = 0;
+	while (this->nodes[node].children >= 0) {
+		int column = square.x >= 0.5f ? 1 : 0;
+		int row = square.y >= 0.5f ? 1 : 0;
+		square = glm::vec2(square.x * 2 - column, square.y * 2 - row);
+		node = this->nodes[node].children + column + 2 * row;
+	}
+	this->nodes[node].energy += energy;
+	this->mutex.unlock();
+}
+
+float PathGuide::updateNode(int node, int depth, float total_energy) {
+	if (this->nodes[node].children < 0) {
+		float energy = this->nodes[node].energy;
+		this->nodes[node].sample_weight = energy;
+		this->nodes[node].energy = 0;
+		if (depth < this->max_depth && energy > this->subdivision_threshold * total_energy) {
+			//Children start with an equal share so the distribution doesn't change until they learn their own energy
+			int first = this->nodes.size();
+			this->nodes[node].children = first;
+			for (int c = 0; c < 4; c++) {
+				this->nodes.push_back({ 0, energy / 4, -1 });
+			}
+		}
+		return energy;
+	}
+	float energy = 0;
+	int first = this->nodes[node].children;
+	for (int c = 0; c < 4; c++) {
+		energy += updateNode(first + c, depth + 1, total_energy);
+	}
+	this->nodes[node].sample_weight = energy;
+	return energy;
+}
+
+void PathGuide::update() {
+	float total_energy = 0;
+	for (int i = 0; i < this->nodes.size(); i++) {
+		if (this->nodes[i].children < 0) {
+			total_energy += this->nodes[i].energy;
+		}
+	}
+	if (total_energy <= 0) {
+		return;
+	}
+	updateNode(0, 0, total_energy);
+	this->trained = true;
+}
+
+void PathGuide::reset() {
+	this->nodes.clear();
+	this->nodes.push_back({ 0, 0, -1 });
+	this->trained = false;
+}
+
+PathGuide::~PathGuide() {
+
+}
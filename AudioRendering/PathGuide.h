@@ -0,0 +1,60 @@
+#pragma once
+/*Learned directional distribution for the rays cast from the source. Directions are mapped to the unit square with
+the cylindrical equal-area mapping (u = (z + 1) / 2, v = azimuth / 2pi), so uniform sampling of the square is uniform
+sampling of the sphere. The square is subdivided as a quadtree whose leaves store the energy that rays emitted in that
+region delivered to the listener. Every ray starts at the source, so the spatial part of the guiding structure is a
+single point and only the directional tree is needed.
+
+Sampling mixes the tree with the uniform distribution so no direction has zero probability and the estimate stays
+unbiased when the rays are weighted by uniform_pdf / pdf.*/
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <mutex>
+
+#define PATH_GUIDE_MAX_DEPTH 10
+//A leaf is subdivided when it holds more than this fraction of the total energy
+#define PATH_GUIDE_SUBDIVISION_THRESHOLD 0.01f
+#define PATH_GUIDE_UNIFORM_FRACTION 0.2f
+#define PATH_GUIDE_ITERATIONS 5
+
+typedef struct guideNode {
+	float energy;			//Energy recorded during the current iteration. Only used in leaves.
+	float sample_weight;	//Energy learned in the previous iterations, used for sampling
+	int children;			//Index of the first of the 4 children, -1 for leaves
+} guideNode;
+
+class PathGuide {
+public:
+	std::vector<guideNode> nodes;
+	//Number of learning iterations the rays are split in
+	int iterations;
+	int max_depth;
+	float subdivision_threshold;
+	float uniform_fraction;
+	//False until some energy has been learned. Until then sampling is uniform.
+	bool trained;
+	std::mutex mutex;
+
+public:
+	PathGuide(int iterations);
+	PathGuide(int iterations, int max_depth, float subdivision_threshold, float uniform_fraction);
+
+	//Samples a direction. pdf is returned relative to the uniform sphere distribution (1 means uniform).
+	glm::vec3 sample(double u1, double u2, double u3, float * pdf);
+	float pdf(glm::vec3 dir);
+
+	//Records the (already weighted) energy that a ray emitted in direction dir delivered to the listener
+	void record(glm::vec3 dir, float energy);
+
+	//Learns the energy recorded in the last iteration and refines the tree
+	void update();
+	void reset();
+	~PathGuide();
+
+private:
+	float updateNode(int node, int depth, float total_energy);
+};
+
+glm::vec2 directionToSquare(glm::vec3 dir);
+glm::vec3 squareToDirection(glm::vec2 square);
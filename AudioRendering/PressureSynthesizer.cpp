@@ -0,0 +1,143 @@
+#define _USE_MATH_DEFINES
+#include "PressureSynthesizer.h"
+#include "AudioRenderingUtils.h"
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <limits>
+
+PressureSynthesizer::PressureSynthesizer(float volume, float bin_length, float max_density) : PressureSynthesizer(volume, bin_length, max_density, sqrt(volume)) {
+}
+
+PressureSynthesizer::PressureSynthesizer(float volume, float bin_length, float max_density, float mixing_time) {
+	this->volume = volume;
+	this->bin_length = bin_length;
+	this->max_density = max_density;
+	this->mixing_time = glm::max(mixing_time, (float)(firstImpulseTime() * 1000));
+	this->sample_rate = 0;
+	this->size = 0;
+}
+
+double PressureSynthesizer::firstImpulseTime() {
+	return cbrt(2 * this->volume * log(2.0) / (4 * M_PI * pow(SPEED_OF_SOUND, 3)));
+}
+
+void PressureSynthesizer::generate(size_t size, unsigned int sample_rate) {
+	this->size = size;
+	this->sample_rate = sample_rate;
+
+	//The sequence is always the same, so consecutive renders don't change the noise
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<double> uniform01(0.0, 1.0);
+	std::vector<float> diracs(size, 0.0f);
+	double c3 = pow(SPEED_OF_SOUND, 3);
+	double t = firstImpulseTime();
+	double length = (double)size / sample_rate;
+	while (t < length) {
+		diracs[(size_t)(t * sample_rate)] += uniform01(generator) < 0.5 ? -1.0f : 1.0f;
+		double density = glm::min(4 * M_PI * c3 * t * t / this->volume, (double)this->max_density);
+		t += -log(1 - uniform01(generator)) / density;
+	}
+
+	this->band_centers.clear();
+	for (float center = SYNTHESIS_LOWEST_BAND; center * M_SQRT2 < sample_rate / 2; center *= 2) {
+		this->band_centers.push_back(center);
+	}
+	size_t bin_samples = glm::max((size_t)1, (size_t)round(this->bin_length * sample_rate / 1000));
+	size_t bins = (size + bin_samples - 1) / bin_samples;
+	this->bands.assign(this->band_centers.size(), std::vector<float>(size));
+	this->bin_energy.assign(this->band_centers.size(), std::vector<double>(bins, 0.0));
+	for (size_t b = 0; b < this->band_centers.size(); b++) {
+		//Octave band pass biquad (RBJ cookbook, 0 dB peak gain)
+		double w0 = 2 * M_PI * this->band_centers[b] / sample_rate;
+		double alpha = sin(w0) * sinh(log(2.0) / 2 * w0 / sin(w0));
+		double a0 = 1 + alpha;
+		double b0 = alpha / a0, b2 = -alpha / a0;
+		double a1 = -2 * cos(w0) / a0, a2 = (1 - alpha) / a0;
+		double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+		std::vector<float> & band = this->bands[b];
+		for (size_t i = 0; i < size; i++) {
+			double y = b0 * diracs[i] + b2 * x2 - a1 * y1 - a2 * y2;
+			x2 = x1;
+			x1 = diracs[i];
+			y2 = y1;
+			y1 = y;
+			band[i] = (float)y;
+			this->bin_energy[b][i / bin_samples] += y * y;
+		}
+	}
+}
+
+void PressureSynthesizer::synthesize(const std::vector<float> & rs, unsigned int sample_rate, std::vector<float> * pressure) {
+	if (rs.size() != this->size || sample_rate != this->sample_rate) {
+		generate(rs.size(), sample_rate);
+	}
+	pressure->assign(rs.size(), 0.0f);
+	if (this->bands.empty()) {
+		return;
+	}
+	size_t bin_samples = glm::max((size_t)1, (size_t)round(this->bin_length * sample_rate / 1000));
+	size_t early_end = glm::min(rs.size(), (size_t)round(this->mixing_time * sample_rate / 1000));
+	size_t fade_end = glm::min(rs.size(), early_end + (size_t)round(SYNTHESIS_CROSSFADE * sample_rate / 1000));
+	//Only the bins after the mixing time are synthesized
+	for (size_t begin = early_end / bin_samples * bin_samples; begin < rs.size(); begin += bin_samples) {
+		size_t end = glm::min(begin + bin_samples, rs.size());
+		double energy = 0;
+		for (size_t i = begin; i < end; i++) {
+			energy += rs[i];
+		}
+		if (energy <= 0) {
+			continue;
+		}
+		//Rs has no frequency information, so every band gets the same share.
+		//The bin is summed in double because the filters barely ring at the first impulses and their gains don't fit in a float.
+		std::vector<double> bin(end - begin, 0.0);
+		double band_energy = energy / this->bands.size();
+		for (size_t b = 0; b < this->bands.size(); b++) {
+			double sequence_energy = this->bin_energy[b][begin / bin_samples];
+			if (sequence_energy <= 0) {
+				continue;
+			}
+			double gain = sqrt(band_energy / sequence_energy);
+			for (size_t i = begin; i < end; i++) {
+				bin[i - begin] += gain * this->bands[b][i];
+			}
+		}
+		//Neighbouring bands overlap, so the sum has more energy than its bands. The bin is scaled back to the energy of Rs.
+		double synthesized_energy = 0;
+		for (size_t i = 0; i < bin.size(); i++) {
+			synthesized_energy += bin[i] * bin[i];
+		}
+		if (synthesized_energy > 0 && std::isfinite(synthesized_energy)) {
+			double correction = sqrt(energy / synthesized_energy);
+			for (size_t i = begin; i < end; i++) {
+				(*pressure)[i] = (float)(bin[i - begin] * correction);
+			}
+		}
+	}
+	//The traced arrivals and the synthesized sequence are uncorrelated, so an equal power crossfade keeps the energy
+	for (size_t i = 0; i < fade_end; i++) {
+		float early = sqrtf(glm::max(rs[i], 0.0f));
+		if (i < early_end) {
+			(*pressure)[i] = early;
+		}
+		else {
+			double angle = M_PI / 2 * (i - early_end) / (fade_end - early_end);
+			(*pressure)[i] = (float)(cos(angle) * early + sin(angle) * (*pressure)[i]);
+		}
+	}
+}
+
+double pressureEnergyDifference(const std::vector<float> & rs, const std::vector<float> & pressure) {
+	double rs_energy = 0;
+	double pressure_energy = 0;
+	for (size_t i = 0; i < rs.size() && i < pressure.size(); i++) {
+		rs_energy += rs[i];
+		pressure_energy += (double)pressure[i] * pressure[i];
+	}
+	if (rs_energy <= 0 || pressure_energy <= 0) {
+		return rs_energy == pressure_energy ? 0 : std::numeric_limits<double>::infinity();
+	}
+	return 10 * log10(pressure_energy / rs_energy);
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*Turns the energy histogram Rs into a pressure impulse response. A room's late response is well modelled by a
+sequence of Dirac impulses of random sign whose arrival times follow a Poisson process of density
+4 pi c^3 t^2 / V (the density of the image sources of a room of volume V). The sequence is split in octave bands, and
+in every band each bin of bin_length ms is scaled so its energy is the band's share of the energy of Rs in that bin.
+
+Before the mixing time the reflections are sparse and the traced ones (the direct sound and the early reflections) are
+the response, so every sample of Rs is kept as a positive impulse with its energy. The synthesized sequence fades in
+after it over SYNTHESIS_CROSSFADE ms.
+
+The envelope only needs the energy per bin, not per sample, so a coarse histogram traced with few rays gives a
+converged sounding response. The sequence and its band filtered versions only depend on the length and sample rate, so
+they are generated once and every render only reweights them.*/
+
+#include <vector>
+#include <cstddef>
+
+#define SYNTHESIS_BIN_LENGTH 1.0f			//ms
+#define SYNTHESIS_MAX_DENSITY 10000.0f		//Impulses per second
+#define SYNTHESIS_LOWEST_BAND 125.0f		//Center of the lowest octave band (Hz)
+#define SYNTHESIS_CROSSFADE 5.0f			//ms
+#define SYNTHESIS_ENERGY_TOLERANCE 0.5		//dB between the energy of the pressure response and Rs before it is reported
+
+class PressureSynthesizer {
+public:
+	float volume;			//m^3
+	float bin_length;		//ms
+	float max_density;
+	float mixing_time;		//ms. Never before the first impulse of the sequence.
+	std::vector<float> band_centers;
+
+private:
+	unsigned int sample_rate;
+	size_t size;
+	std::vector<std::vector<float>> bands;			//Dirac sequence filtered by each band
+	std::vector<std::vector<double>> bin_energy;	//Energy of each band in each bin
+
+public:
+	//The mixing time is estimated as sqrt(volume) ms
+	PressureSynthesizer(float volume, float bin_length, float max_density);
+	PressureSynthesizer(float volume, float bin_length, float max_density, float mixing_time);
+	//Writes to pressure the impulse response of the same length as rs
+	void synthesize(const std::vector<float> & rs, unsigned int sample_rate, std::vector<float> * pressure);
+
+private:
+	//Time (s) at which the expected number of impulses of the room is 1
+	double firstImpulseTime();
+	void generate(size_t size, unsigned int sample_rate);
+};
+
+//Level of the energy of pressure relative to the energy of rs, in dB. 0 if the synthesis kept the energy.
+double pressureEnergyDifference(const std::vector<float> & rs, const std::vector<float> & pressure);
@@ -0,0 +1,299 @@
+#include "RadianceTransfer.h"
+
+#include <random>
+#include <cmath>
+
+#include "ImageSource.h"
+
+AcousticRadianceTransfer::AcousticRadianceTransfer(Scene * scene, float source_power, float reflexion_coef, float patch_area, int rays_per_patch, int bin_rate, float start_time) {
+	this->scene = scene;
+	this->source_power = source_power;
+	this->reflexion_coef = reflexion_coef;
+	this->patch_area = patch_area;
+	this->rays_per_patch = rays_per_patch;
+	this->bin_rate = bin_rate;
+	this->start_time = start_time;
+	this->precomputed = false;
+	this->geometry_version = 0;
+	this->response_bins = 0;
+}
+
+subdivisionTable * AcousticRadianceTransfer::getSubdivision(int resolution) {
+	auto it = this->subdivisions.find(resolution);
+	if (it != this->subdivisions.end()) {
+		return &it->second;
+	}
+	subdivisionTable * table = &this->subdivisions[resolution];
+	table->lookup.resize(resolution * resolution * 2, -1);
+	for (int i = 0; i < resolution; i++) {
+		for (int j = 0; i + j < resolution; j++) {
+			table->lookup[(i * resolution + j) * 2] = table->cells.size();
+			table->cells.push_back(glm::ivec3(i, j, 0));
+			if (i + j < resolution - 1) {
+				table->lookup[(i * resolution + j) * 2 + 1] = table->cells.size();
+				table->cells.push_back(glm::ivec3(i, j, 1));
+			}
+		}
+	}
+	return table;
+}
+
+glm::vec3 AcousticRadianceTransfer::subTrianglePoint(glm::vec3 * triangle, int resolution, int sub_triangle, float r1, float r2) {
+	glm::ivec3 cell = getSubdivision(resolution)->cells[sub_triangle];
+	glm::vec2 corners[3];
+	if (cell.z == 0) {
+		corners[0] = glm::vec2(cell.x, cell.y);
+		corners[1] = glm::vec2(cell.x + 1, cell.y);
+		corners[2] = glm::vec2(cell.x, cell.y + 1);
+	}
+	else {
+		corners[0] = glm::vec2(cell.x + 1, cell.y);
+		corners[1] = glm::vec2(cell.x + 1, cell.y + 1);
+		corners[2] = glm::vec2(cell.x, cell.y + 1);
+	}
+	float a = sqrtf(r1);
+	glm::vec2 uv = ((1 - a) * corners[0] + a * (1 - r2) * corners[1] + a * r2 * corners[2]) / (float)resolution;
+	return triangle[0] + uv.x * (triangle[1] - triangle[0]) + uv.y * (triangle[2] - triangle[0]);
+}
+
+int AcousticRadianceTransfer::findPatch(unsigned int geomID, unsigned int primID, float u, float v, glm::vec3 dir) {
+	if (geomID == RTC_INVALID_GEOMETRY_ID || geomID >= this->geometry_offsets.size()) {
+		return -1;
+	}
+	int primitive = this->geometry_offsets[geomID] + primID;
+	int t = this->primitive_triangles[primitive];
+	//Embree's quad coordinates go from 0 to 1 on both axes, the second half has them mirrored
+	if (this->primitive_triangles[primitive + 1] - t == 2 && u + v > 1) {
+		t++;
+		u = 1 - u;
+		v = 1 - v;
+	}
+	patchedTriangle * triangle = &this->triangles[t];
+	int n = triangle->resolution;
+	//u, v are the barycentric coordinates of the hit relative to vertices 1 and 2
+	int i = glm::clamp((int)(u * n), 0, n - 1);
+	int j = glm::clamp((int)(v * n), 0, n - 1);
+	if (i + j > n - 1) {
+		j = n - 1 - i;
+	}
+	int inverted = (u * n - i) + (v * n - j) > 1 && i + j < n - 1 ? 1 : 0;
+	int sub_triangle = getSubdivision(n)->lookup[(i * n + j) * 2 + inverted];
+	//The front patch receives the rays that arrive against its normal
+	int side = glm::dot(dir, this->patches[triangle->first_patch].normal) < 0 ? 0 : 1;
+	return triangle->first_patch + sub_triangle * 2 + side;
+}
+
+void AcousticRadianceTransfer::precompute() {
+	//PATCHES ------------------------------------------------------------------------
+	this->patches.clear();
+	this->triangles.clear();
+	this->primitive_triangles.clear();
+	this->geometry_offsets.clear();
+	for (unsigned int geomID = 0; geomID < this->scene->primitive_counts.size(); geomID++) {
+		this->geometry_offsets.push_back(this->primitive_triangles.size());
+		//The patches are kept while the static geometry doesn't change, so dynamic objects don't have any
+		if (this->scene->isDynamic(geomID)) {
+			continue;
+		}
+		for (unsigned int primID = 0; primID < this->scene->primitive_counts[geomID]; primID++) {
+			glm::vec3 vertices[SCENE_MAX_PRIMITIVE_VERTICES];
+			unsigned int count = this->scene->getPrimitive(geomID, primID, vertices);
+			glm::vec3 halves[2][3] = { { vertices[0], vertices[1], count == 4 ? vertices[3] : vertices[2] }, { vertices[2], vertices[3], vertices[1] } };
+			this->primitive_triangles.push_back(this->triangles.size());
+			for (unsigned int h = 0; h < count - 2; h++) {
+				glm::vec3 * triangle = halves[h];
+				glm::vec3 cross = glm::cross(triangle[1] - triangle[0], triangle[2] - triangle[0]);
+				float area = glm::length(cross) / 2;
+				glm::vec3 normal = area > 0 ? glm::normalize(cross) : glm::vec3(0, 0, 1);
+				int resolution = glm::clamp((int)ceil(sqrt(area / this->patch_area)), 1, RADIANCE_TRANSFER_MAX_RESOLUTION);
+
+				patchedTriangle patched = { (int)this->patches.size(), resolution, { triangle[0], triangle[1], triangle[2] } };
+				this->triangles.push_back(patched);
+				int sub_triangles = resolution * resolution;
+				float sub_area = area / sub_triangles;
+				for (int s = 0; s < sub_triangles; s++) {
+					glm::vec3 center = subTrianglePoint(triangle, resolution, s, 4.0f / 9.0f, 0.5f);
+					this->patches.push_back({ center, normal, sub_area });
+					this->patches.push_back({ center, -normal, sub_area });
+				}
+			}
+		}
+	}
+	this->primitive_triangles.push_back(this->triangles.size());
+
+	//FORM FACTORS -------------------------------------------------------------------
+	/*The form factor F_ij is the fraction of the energy leaving patch i (diffusely) that arrives to patch j. It is estimated
+	with cosine distributed rays from random points of patch i.*/
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<float> uniform01(0.0f, 1.0f);
+	staticIntersectContext context;
+	this->scene->initStaticContext(&context);
+
+	this->link_offsets.assign(1, 0);
+	this->links.clear();
+	std::map<int, std::pair<int, float>> hits;		//patch -> (ray count, distance sum)
+	for (int t = 0; t < this->triangles.size(); t++) {
+		glm::vec3 * triangle = this->triangles[t].vertices;
+		int resolution = this->triangles[t].resolution;
+
+		for (int s = 0; s < resolution * resolution; s++) {
+			for (int side = 0; side < 2; side++) {
+				int patch_index = this->triangles[t].first_patch + s * 2 + side;
+				glm::vec3 normal = this->patches[patch_index].normal;
+				//Orthonormal basis around the normal
+				glm::vec3 tangent = glm::normalize(fabs(normal.x) > 0.9f ? glm::cross(normal, glm::vec3(0, 1, 0)) : glm::cross(normal, glm::vec3(1, 0, 0)));
+				glm::vec3 bitangent = glm::cross(normal, tangent);
+
+				hits.clear();
+				for (int r = 0; r < this->rays_per_patch; r++) {
+					glm::vec3 origin = subTrianglePoint(triangle, resolution, s, uniform01(generator), uniform01(generator));
+					float r1 = uniform01(generator);
+					float phi = 2 * M_PI * uniform01(generator);
+					float radius = sqrtf(r1);
+					glm::vec3 dir = radius * cosf(phi) * tangent + radius * sinf(phi) * bitangent + sqrtf(1 - r1) * normal;
+
+					struct RTCRayHit rayhit;
+					rayhit.ray.org_x = origin.x;
+					rayhit.ray.org_y = origin.y;
+					rayhit.ray.org_z = origin.z;
+					rayhit.ray.dir_x = dir.x;
+					rayhit.ray.dir_y = dir.y;
+					rayhit.ray.dir_z = dir.z;
+					rayhit.ray.tnear = 0.001f;
+					rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+					rayhit.ray.mask = -1;
+					rayhit.ray.flags = 0;
+					rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+					rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+					rtcIntersect1(this->scene->getRTCScene(), &context.context, &rayhit);
+
+					int hit_patch = findPatch(this->scene->hitObject(rayhit.hit), rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v, dir);
+					if (hit_patch >= 0) {
+						hits[hit_patch].first++;
+						hits[hit_patch].second += rayhit.ray.tfar;
+					}
+				}
+				for (auto it = hits.begin(); it != hits.end(); ++it) {
+					float distance = it->second.second / it->second.first;
+					//At least one bin of delay so the propagation always moves forward in time
+					int delay = glm::max(1, (int)round(distance / SPEED_OF_SOUND * this->bin_rate));
+					this->links.push_back({ it->first, (float)it->second.first / this->rays_per_patch, delay });
+				}
+				this->link_offsets.push_back(this->links.size());
+			}
+		}
+	}
+	this->precomputed = true;
+	this->geometry_version = this->scene->geometry_version;
+	this->response_bins = 0;
+}
+
+void AcousticRadianceTransfer::propagate(glm::vec3 source_pos, int bins) {
+	int num_patches = this->patches.size();
+	this->response.assign((size_t)bins * num_patches, 0.0f);
+	this->response_source = source_pos;
+	this->response_bins = bins;
+
+	//SHOOT --------------------------------------------------------------------------
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<double> uniform01(0.0, 1.0);
+	staticIntersectContext context;
+	this->scene->initStaticContext(&context);
+	float ray_energy = this->source_power / RADIANCE_TRANSFER_SOURCE_RAYS;
+	for (int r = 0; r < RADIANCE_TRANSFER_SOURCE_RAYS; r++) {
+		double theta = 2 * M_PI * uniform01(generator);
+		double phi = acos(1 - 2 * uniform01(generator));
+		glm::vec3 dir = glm::normalize(glm::vec3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)));
+
+		struct RTCRayHit rayhit;
+		rayhit.ray.org_x = source_pos.x;
+		rayhit.ray.org_y = source_pos.y;
+		rayhit.ray.org_z = source_pos.z;
+		rayhit.ray.dir_x = dir.x;
+		rayhit.ray.dir_y = dir.y;
+		rayhit.ray.dir_z = dir.z;
+		rayhit.ray.tnear = 0;
+		rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+		rayhit.ray.mask = -1;
+		rayhit.ray.flags = 0;
+		rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+		rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+		rtcIntersect1(this->scene->getRTCScene(), &context.context, &rayhit);
+
+		int hit_patch = findPatch(this->scene->hitObject(rayhit.hit), rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v, dir);
+		int bin = round(rayhit.ray.tfar / SPEED_OF_SOUND * this->bin_rate);
+		if (hit_patch >= 0 && bin < bins) {
+			this->response[(size_t)bin * num_patches + hit_patch] += ray_energy * this->reflexion_coef;
+		}
+	}
+
+	//PROPAGATION --------------------------------------------------------------------
+	//Every link has a delay of at least one bin, so when bin t is processed all the energy that arrives to it is known
+	for (int t = 0; t < bins; t++) {
+		float * leaving = &this->response[(size_t)t * num_patches];
+		for (int i = 0; i < num_patches; i++) {
+			float energy = leaving[i];
+			if (energy <= 0) {
+				continue;
+			}
+			for (int l = this->link_offsets[i]; l < this->link_offsets[i + 1]; l++) {
+				int arrival = t + this->links[l].delay;
+				if (arrival < bins) {
+					this->response[(size_t)arrival * num_patches + this->links[l].patch] += energy * this->links[l].form_factor * this->reflexion_coef;
+				}
+			}
+		}
+	}
+}
+
+void AcousticRadianceTransfer::render(glm::vec3 source_pos, glm::vec3 listener_pos, std::vector<float> * rs, int sample_rate) {
+	if (!this->precomputed || this->geometry_version != this->scene->geometry_version) {
+		precompute();
+	}
+	int bins = ceil((float)rs->size() / sample_rate * this->bin_rate);
+	if (this->response_bins < bins || this->response_source != source_pos) {
+		propagate(source_pos, bins);
+	}
+
+	//GATHER -------------------------------------------------------------------------
+	int num_patches = this->patches.size();
+	float samples_per_bin = (float)sample_rate / this->bin_rate;
+	for (int i = 0; i < num_patches; i++) {
+		glm::vec3 to_listener = listener_pos - this->patches[i].center;
+		float distance = glm::length(to_listener);
+		float cosine = glm::dot(this->patches[i].normal, to_listener) / distance;
+		if (cosine <= 0) {
+			continue;
+		}
+		if (!isSegmentVisible(this->scene, this->patches[i].center + this->patches[i].normal * 0.001f, listener_pos)) {
+			continue;
+		}
+		//Lambertian patch: the energy per unit area at the listener is E cos / (pi d^2). The distance is clamped so a
+		//listener on the patch doesn't receive more than the energy per area of the patch.
+		float weight = cosine / (M_PI * glm::max(distance * distance, this->patches[i].area / (float)M_PI));
+		float delay = distance / SPEED_OF_SOUND;
+		for (int t = 0; t < bins; t++) {
+			float energy = this->response[(size_t)t * num_patches + i];
+			if (energy <= 0) {
+				continue;
+			}
+			float arrival = (float)t / this->bin_rate + delay;
+			if (arrival < this->start_time) {
+				continue;
+			}
+			//The energy of the bin is spread over the samples it covers
+			int first_sample = round(arrival * sample_rate);
+			int last_sample = round((arrival + 1.0f / this->bin_rate) * sample_rate);
+			float sample_energy = energy * weight / glm::max(1, last_sample - first_sample);
+			for (int s = first_sample; s < last_sample && s < (int)rs->size(); s++) {
+				(*rs)[s] += sample_energy;
+			}
+		}
+	}
+}
+
+AcousticRadianceTransfer::~AcousticRadianceTransfer() {
+
+}
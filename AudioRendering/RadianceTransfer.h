@@ -0,0 +1,101 @@
+#pragma once
+/*Acoustic radiance transfer for the late, diffuse part of the impulse response. The mesh is divided in patches
+(every triangle is subdivided until its parts are smaller than patch_area, and each part has a patch for each side).
+The form factors and delays between patches are precomputed once with rays cast from every patch. Only the static
+geometry has patches and blocks those rays, so moving the dynamic objects doesn't invalidate them.
+
+For a source position the energy is shot from the source to the patches and then propagated between them in time bins,
+every patch being an ideal diffuse (Lambertian) reflector. The result is cached, so if only the listener moves the
+response is obtained by gathering the energy that the visible patches radiate towards it.*/
+
+#include <embree3/rtcore.h>
+#include <embree3/rtcore_common.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+
+#define RADIANCE_TRANSFER_PATCH_AREA 1.0f
+#define RADIANCE_TRANSFER_RAYS 64
+#define RADIANCE_TRANSFER_BIN_RATE 1000
+#define RADIANCE_TRANSFER_SOURCE_RAYS 100000
+#define RADIANCE_TRANSFER_MAX_RESOLUTION 64
+
+typedef struct patch {
+	glm::vec3 center;
+	glm::vec3 normal;	//Points to the side of the triangle this patch radiates to
+	float area;
+} patch;
+
+typedef struct patchLink {
+	int patch;
+	float form_factor;
+	int delay;			//In bins
+} patchLink;
+
+typedef struct patchedTriangle {
+	int first_patch;	//Sub triangle s has patches first_patch + 2 * s (front) and first_patch + 2 * s + 1 (back)
+	int resolution;		//The triangle is divided in resolution^2 sub triangles
+	glm::vec3 vertices[3];
+} patchedTriangle;
+
+//Subdivision of a triangle in n^2 sub triangles in barycentric coordinates. Cell (i, j) has an upright sub triangle and,
+//if i + j < n - 1, an inverted one.
+typedef struct subdivisionTable {
+	std::vector<glm::ivec3> cells;	//(i, j, inverted) of each sub triangle
+	std::vector<int> lookup;		//Sub triangle of cell (i, j, inverted) at (i * n + j) * 2 + inverted
+} subdivisionTable;
+
+class AcousticRadianceTransfer {
+public:
+	Scene * scene;
+	float source_power;
+	float reflexion_coef;
+	float patch_area;
+	int rays_per_patch;
+	int bin_rate;
+	//Only the energy that arrives after start_time (in seconds) is rendered, the earlier part is left to the ray tracer
+	float start_time;
+
+	std::vector<patch> patches;
+	std::vector<patchedTriangle> triangles;
+	/*Index in triangles of each primitive. Quads are split in two triangles like embree does, (0, 1, 3) and (2, 3, 1),
+	so the hit's u, v select the half. There is one extra entry at the end so primitive p spans up to entry p + 1.*/
+	std::vector<int> primitive_triangles;
+	std::vector<int> geometry_offsets;		//Index in primitive_triangles of the first primitive of each geometry
+	std::map<int, subdivisionTable> subdivisions;
+	//Links of patch i are links[link_offsets[i]] to links[link_offsets[i + 1] - 1]
+	std::vector<int> link_offsets;
+	std::vector<patchLink> links;
+	bool precomputed;
+	//Scene geometry version the patches were built for. If an object moves everything is precomputed again.
+	unsigned int geometry_version;
+
+	//Energy leaving each patch in each time bin for the cached source: response[bin * patches + patch]
+	std::vector<float> response;
+	glm::vec3 response_source;
+	int response_bins;
+
+public:
+	AcousticRadianceTransfer(Scene * scene, float source_power, float reflexion_coef, float patch_area, int rays_per_patch, int bin_rate, float start_time);
+
+	//Builds the patches and the form factors. Done once, the first time the late field is rendered.
+	void precompute();
+
+	//Shoots the energy from the source and propagates it between the patches for bins time bins
+	void propagate(glm::vec3 source_pos, int bins);
+
+	//Adds to rs (at sample_rate) the energy radiated by the patches to the listener that arrives after start_time
+	void render(glm::vec3 source_pos, glm::vec3 listener_pos, std::vector<float> * rs, int sample_rate);
+
+	~AcousticRadianceTransfer();
+
+private:
+	//Patch hit by a ray, -1 if the hit is not in the scene
+	int findPatch(unsigned int geomID, unsigned int primID, float u, float v, glm::vec3 dir);
+	subdivisionTable * getSubdivision(int resolution);
+	//Point of sub_triangle for the uniform random numbers r1, r2
+	glm::vec3 subTrianglePoint(glm::vec3 * triangle, int resolution, int sub_triangle, float r1, float r2);
+};
@@ -1,86 +1,377 @@
 #include "Scene.h"
 #include "OBJLoader.h"
+#include "MeshSimplifier.h"
 #include <functional>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <glm/gtx/transform.hpp>
+
+//Memory allocated by the embree device, updated by embreeMemoryMonitor
+static std::atomic<long long> embree_bytes(0);
+static std::atomic<long long> embree_peak_bytes(0);
+
+static bool embreeMemoryMonitor(void * user_ptr, ssize_t bytes, bool post) {
+	long long current = embree_bytes += bytes;
+	long long peak = embree_peak_bytes.load();
+	while (current > peak && !embree_peak_bytes.compare_exchange_weak(peak, current)) {}
+	//Returning false would make the allocation fail
+	return true;
+}
+
+void trackDeviceMemory(RTCDevice device) {
+	rtcSetDeviceMemoryMonitorFunction(device, embreeMemoryMonitor, NULL);
+}
+
+//The monitor counts the whole device, so a scene's memory is measured around each of its builds. Returns the start.
+static long long beginEmbreeMeasure() {
+	long long current = embree_bytes.load();
+	embree_peak_bytes.store(current);
+	return current;
+}
+
+static void endEmbreeMeasure(sceneMemory * memory, long long start) {
+	memory->embree_peak = std::max(memory->embree_peak, memory->embree + embree_peak_bytes.load() - start);
+	memory->embree += embree_bytes.load() - start;
+}
+
+static void initTopLevelScene(RTCScene rtc_scene) {
+	//Moving an object only changes its instance transform, so the top level BVH (one leaf per instance) is rebuilt fast
+	//instead of well. The meshes of the objects keep their BVHs.
+	rtcSetSceneFlags(rtc_scene, RTC_SCENE_FLAG_DYNAMIC | RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+	rtcSetSceneBuildQuality(rtc_scene, RTC_BUILD_QUALITY_LOW);
+}
+
+//Context filter of staticIntersectContext. Rejects the hits on dynamic objects so the rays go through them.
+static void ignoreDynamicObjects(const RTCFilterFunctionNArguments * args) {
+	const staticIntersectContext * context = (const staticIntersectContext *)args->context;
+	for (unsigned int i = 0; i < args->N; i++) {
+		if (args->valid[i] != 0 && context->scene->isDynamic(RTCHitN_instID(args->hit, args->N, i, 0))) {
+			args->valid[i] = 0;
+		}
+	}
+}
 
 Scene::Scene(RTCDevice device) {
 	this->rtc_scene = rtcNewScene(device);
+	this->geometry_version = 0;
+	this->dynamic_version = 0;
+	this->simplify_tolerance = 0;
+	this->compact = false;
+	this->verbose = false;
+	this->memory = { 0, 0, 0, 0, 0, 0 };
+	initTopLevelScene(this->rtc_scene);
 }
 
 AuralizationScene::AuralizationScene(RTCDevice device) {
 	this->rtc_scene = rtcNewScene(device);
+	this->geometry_version = 0;
+	this->dynamic_version = 0;
+	this->simplify_tolerance = 0;
+	this->compact = false;
+	this->verbose = false;
+	this->memory = { 0, 0, 0, 0, 0, 0 };
+	initTopLevelScene(this->rtc_scene);
 }
 
-static void createEmbreeGeometry(RTCDevice * device, OBJProperites props, RTCScene rtc_scene) {
-	RTCGeometry geom = rtcNewGeometry(*device, RTC_GEOMETRY_TYPE_TRIANGLE);
+static unsigned int createEmbreeGeometry(RTCDevice * device, OBJProperites * mesh, RTCScene rtc_scene) {
+	//Meshes with quads are quad meshes, their triangles repeat the last vertex
+	unsigned int face_size = mesh->quads ? 4 : 3;
+	RTCGeometry geom = rtcNewGeometry(*device, mesh->quads ? RTC_GEOMETRY_TYPE_QUAD : RTC_GEOMETRY_TYPE_TRIANGLE);
+
+	size_t vertex_count = mesh->vertices.size() / 3;
+	//Embree reads vertices with 16 byte loads, so shared vertex buffers need 4 bytes of padding after the last one
+	mesh->vertices.push_back(0.0f);
 
-	float* vertices = (float*)rtcSetNewGeometryBuffer(geom,
+	//The buffers are shared, embree reads them from mesh instead of keeping its own copy
+	rtcSetSharedGeometryBuffer(geom,
 		RTC_BUFFER_TYPE_VERTEX,
 		0,
 		RTC_FORMAT_FLOAT3,
+		mesh->vertices.data(),
+		0,
 		3 * sizeof(float),
-		props.vertices.size() / 3); //VERTEX COUNT (3 floats represent 1 vertex)
-
-	std::copy(props.vertices.begin(), props.vertices.end(), vertices);
+		vertex_count); //VERTEX COUNT (3 floats represent 1 vertex)
 
-	unsigned int* indices = (unsigned int*)rtcSetNewGeometryBuffer(geom,
+	rtcSetSharedGeometryBuffer(geom,
 		RTC_BUFFER_TYPE_INDEX,
 		0,
-		RTC_FORMAT_UINT3,
-		3 * sizeof(unsigned int),
-		props.indices.size() / 3); //FACE COUNT (3 indices are counted as 1 item since they represent a single triangle)
-
-	std::copy(props.indices.begin(), props.indices.end(), indices);
-
+		mesh->quads ? RTC_FORMAT_UINT4 : RTC_FORMAT_UINT3,
+		mesh->indices.data(),
+		0,
+		face_size * sizeof(unsigned int),
+		mesh->indices.size() / face_size); //FACE COUNT (3 or 4 indices are counted as 1 item since they represent a single face)
 
 	rtcCommitGeometry(geom);
 
-	rtcAttachGeometry(rtc_scene, geom);
+	unsigned int geomID = rtcAttachGeometry(rtc_scene, geom);
 	rtcReleaseGeometry(geom);
+	return geomID;
 }
 
 void Scene::addObjectFromOBJ(std::string file_name, glm::vec3 pos, float size, RTCDevice * device) {
-	//Create mesh in scene
-	OBJProperites props = loadOBJ(file_name);
+	//The mesh stays in object space, the position and size go in the instance transform
+	if (device) {
+		unsigned int prototype = loadPrototype(file_name, size, device);
+		addInstance(prototype, glm::translate(pos) * glm::scale(glm::vec3(size)), device);
+	}
+}
 
-	for (int i = 0; i < props.vertices.size(); i = i + 3) {
-		props.vertices[i] *= size;
-		props.vertices[i + 1] *= size;
-		props.vertices[i + 2] *= size;
-		props.vertices[i] += pos.x;
-		props.vertices[i + 1] += pos.y;
-		props.vertices[i + 2] += pos.z;
+std::string Scene::prototypeKey(std::string file_name, float size) {
+	if (this->simplify_tolerance > 0 && !this->compact) {
+		return file_name + "@" + std::to_string(size);
 	}
+	return file_name;
+}
 
-	if (device) {
-		createEmbreeGeometry(device, props, this->rtc_scene);
+unsigned int Scene::addObjectInstance(std::string file_name, glm::vec3 pos, float size, glm::mat4 rotation, RTCDevice * device) {
+	std::string key = prototypeKey(file_name, size);
+	auto it = this->prototype_files.find(key);
+	unsigned int prototype;
+	if (it != this->prototype_files.end()) {
+		prototype = it->second;
+	}
+	else {
+		prototype = loadPrototype(file_name, size, device);
+		this->prototype_files[key] = prototype;
+	}
+	return addInstance(prototype, glm::translate(pos) * rotation * glm::scale(glm::vec3(size)), device);
+}
+
+OBJProperites * Scene::loadMesh(std::string file_name, float size) {
+	size_t parse_bytes = 0;
+	OBJProperites * mesh = new OBJProperites(loadOBJ(file_name, &parse_bytes));
+	this->memory.parse = std::max(this->memory.parse, parse_bytes);
+	if (this->simplify_tolerance > 0) {
+		//The mesh is in object space, so the tolerance is scaled to it
+		simplificationStats stats = simplifyMesh(mesh, this->simplify_tolerance / size);
+		if (this->verbose) {
+			printSimplificationStats(file_name, stats);
+		}
+	}
+	return mesh;
+}
+
+unsigned int Scene::loadPrototype(std::string file_name, float size, RTCDevice * device) {
+	if (this->compact) {
+		return addCompactPrototype(file_name, device);
+	}
+	return addPrototype(loadMesh(file_name, size), device);
+}
+
+unsigned int Scene::addPrototype(OBJProperites * mesh, RTCDevice * device) {
+	long long embree_start = beginEmbreeMeasure();
+	scenePrototype prototype;
+	prototype.rtc_scene = rtcNewScene(*device);
+	//The context filter has to be enabled where the primitives are, it's how the rays skip dynamic objects
+	rtcSetSceneFlags(prototype.rtc_scene, RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+	prototype.face_size = mesh->quads ? 4 : 3;
+	prototype.primitive_count = mesh->indices.size() / prototype.face_size;
+	prototype.vertex_count = mesh->vertices.size() / 3;
+	prototype.mesh = mesh;
+	createEmbreeGeometry(device, mesh, prototype.rtc_scene);
+	rtcCommitScene(prototype.rtc_scene);
+	size_t bytes = mesh->vertices.size() * sizeof(float) + mesh->indices.size() * sizeof(unsigned int);
+	this->memory.buffers += bytes;
+	this->memory.shared += bytes;
+	endEmbreeMeasure(&this->memory, embree_start);
+	this->prototypes.push_back(prototype);
+	return this->prototypes.size() - 1;
+}
+
+unsigned int Scene::addCompactPrototype(std::string file_name, RTCDevice * device) {
+	if (this->simplify_tolerance > 0 && this->verbose) {
+		std::cout << file_name << " is loaded as a large mesh and will not be simplified" << std::endl;
+	}
+	long long embree_start = beginEmbreeMeasure();
+	scenePrototype prototype;
+	prototype.rtc_scene = rtcNewScene(*device);
+	//Compact BVH nodes trade some tracing speed for memory
+	rtcSetSceneFlags(prototype.rtc_scene, RTC_SCENE_FLAG_COMPACT | RTC_SCENE_FLAG_CONTEXT_FILTER_FUNCTION);
+	size_t vertex_count, triangle_count;
+	//A file that can't be read is an empty prototype, so its objects are never hit
+	if (countOBJ(file_name, &vertex_count, &triangle_count) && vertex_count > 0 && triangle_count > 0) {
+		//The file is parsed straight into embree's buffers, there is no intermediate copy of the mesh
+		RTCGeometry geom = rtcNewGeometry(*device, RTC_GEOMETRY_TYPE_TRIANGLE);
+		float * vertices = (float*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, 3 * sizeof(float), vertex_count);
+		unsigned int * indices = (unsigned int*)rtcSetNewGeometryBuffer(geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, 3 * sizeof(unsigned int), triangle_count);
+		if (!streamOBJ(file_name, vertex_count, triangle_count, vertices, indices)) {
+			std::cout << "Error loading " << file_name << ", its invalid faces are left out" << std::endl;
+		}
+		rtcCommitGeometry(geom);
+		rtcAttachGeometry(prototype.rtc_scene, geom);
+		rtcReleaseGeometry(geom);
+	}
+	else {
+		vertex_count = 0;
+		triangle_count = 0;
+	}
+	rtcCommitScene(prototype.rtc_scene);
+	prototype.face_size = 3;
+	prototype.primitive_count = triangle_count;
+	prototype.vertex_count = vertex_count;
+	prototype.mesh = NULL;
+	this->memory.buffers += vertex_count * 3 * sizeof(float) + triangle_count * 3 * sizeof(unsigned int);
+	endEmbreeMeasure(&this->memory, embree_start);
+	this->prototypes.push_back(prototype);
+	if (this->verbose) {
+		std::cout << "Large mesh " << file_name << ": " << vertex_count << " vertices, " << triangle_count << " triangles" << std::endl;
+	}
+	return this->prototypes.size() - 1;
+}
+
+unsigned int Scene::addInstance(unsigned int prototype, glm::mat4 transform, RTCDevice * device) {
+	long long embree_start = beginEmbreeMeasure();
+	RTCGeometry instance = rtcNewGeometry(*device, RTC_GEOMETRY_TYPE_INSTANCE);
+	rtcSetGeometryInstancedScene(instance, this->prototypes[prototype].rtc_scene);
+	rtcSetGeometryTimeStepCount(instance, 1);
+	rtcSetGeometryTransform(instance, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, &transform[0][0]);
+	rtcCommitGeometry(instance);
+	unsigned int instID = rtcAttachGeometry(this->rtc_scene, instance);
+	rtcReleaseGeometry(instance);
+	endEmbreeMeasure(&this->memory, embree_start);
+
+	if (instID >= this->instances.size()) {
+		this->instances.resize(instID + 1);
+		this->primitive_counts.resize(instID + 1, 0);
+	}
+	this->instances[instID] = { prototype, transform, glm::transpose(glm::inverse(glm::mat3(transform))), false };
+	this->primitive_counts[instID] = this->prototypes[prototype].primitive_count;
+	return instID;
+}
+
+void Scene::setTransform(unsigned int instance, glm::mat4 transform) {
+	RTCGeometry geom = rtcGetGeometry(this->rtc_scene, instance);
+	rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, &transform[0][0]);
+	rtcCommitGeometry(geom);
+	this->instances[instance].transform = transform;
+	this->instances[instance].normal_transform = glm::transpose(glm::inverse(glm::mat3(transform)));
+	if (this->instances[instance].dynamic) {
+		this->dynamic_version++;
+	}
+	else {
+		this->geometry_version++;
+	}
+}
+
+void Scene::setDynamic(unsigned int instance) {
+	if (!this->instances[instance].dynamic) {
+		//Cached results saw the object, now they have to be computed without it
+		this->instances[instance].dynamic = true;
+		this->geometry_version++;
 	}
 }
 
+bool Scene::isDynamic(unsigned int instance) const {
+	return instance < this->instances.size() && this->instances[instance].dynamic;
+}
+
+void Scene::initStaticContext(staticIntersectContext * context) {
+	rtcInitIntersectContext(&context->context);
+	context->context.filter = ignoreDynamicObjects;
+	context->scene = this;
+}
+
 void AuralizationScene::addObjectFromOBJ(std::string file_name, glm::vec3 pos, float size, RTCDevice * device) {
-	//Create mesh in scene
-	OBJProperites props = loadOBJ(file_name);
+	unsigned int prototype = loadPrototype(file_name, size, device);
+	if (prototype >= this->prototype_meshes.size()) {
+		this->prototype_meshes.resize(prototype + 1, NULL);
+	}
+	//The drawn mesh belongs to the prototype, the object only references it
+	this->prototype_meshes[prototype] = createPrototypeMesh(prototype);
+	SceneObject * object = new SceneObject(pos, size, this->prototype_meshes[prototype]);
+	this->objects.push_back(object);
+
+	//Embree uses the same model matrix as the drawn mesh, so object i is instance i
+	addInstance(prototype, object->getModelMatrix(), device);
+}
 
-	SceneObject * object = new SceneObject(pos,size, props);
+unsigned int AuralizationScene::addObjectInstance(std::string file_name, glm::vec3 pos, float size, glm::mat4 rotation, RTCDevice * device) {
+	std::string key = prototypeKey(file_name, size);
+	auto it = this->prototype_files.find(key);
+	unsigned int prototype;
+	if (it != this->prototype_files.end()) {
+		prototype = it->second;
+	}
+	else {
+		prototype = loadPrototype(file_name, size, device);
+		this->prototype_files[key] = prototype;
+		if (prototype >= this->prototype_meshes.size()) {
+			this->prototype_meshes.resize(prototype + 1, NULL);
+		}
+		this->prototype_meshes[prototype] = createPrototypeMesh(prototype);
+	}
+	SceneObject * object = new SceneObject(pos, size, this->prototype_meshes[prototype]);
+	object->rotation = rotation;
 	this->objects.push_back(object);
-	//delete[](props.normals);
+	return addInstance(prototype, object->getModelMatrix(), device);
+}
 
-	//Scale and translate vertices for embree
-	for (int i = 0; i < props.vertices.size(); i = i + 3) {
-		props.vertices[i] *= size;
-		props.vertices[i+1] *= size;
-		props.vertices[i+2] *= size;
-		props.vertices[i] += pos.x;
-		props.vertices[i + 1] += pos.y;
-		props.vertices[i + 2] += pos.z;
+//Area weighted vertex normals
+static void computeVertexNormals(const float * vertices, size_t vertex_count, const unsigned int * indices, size_t triangle_count, std::vector<float> * normals) {
+	normals->assign(vertex_count * 3, 0.0f);
+	for (size_t t = 0; t < triangle_count; t++) {
+		glm::vec3 v[3];
+		for (int k = 0; k < 3; k++) {
+			v[k] = glm::vec3(vertices[indices[t * 3 + k] * 3], vertices[indices[t * 3 + k] * 3 + 1], vertices[indices[t * 3 + k] * 3 + 2]);
+		}
+		glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+		for (int k = 0; k < 3; k++) {
+			for (int c = 0; c < 3; c++) {
+				(*normals)[indices[t * 3 + k] * 3 + c] += normal[c];
+			}
+		}
 	}
+	for (size_t i = 0; i < vertex_count; i++) {
+		glm::vec3 normal = glm::vec3((*normals)[i * 3], (*normals)[i * 3 + 1], (*normals)[i * 3 + 2]);
+		float length = glm::length(normal);
+		if (length > 0) {
+			for (int c = 0; c < 3; c++) {
+				(*normals)[i * 3 + c] = normal[c] / length;
+			}
+		}
+	}
+}
 
-	if (device) {
-		createEmbreeGeometry(device, props, this->rtc_scene);
+Mesh * AuralizationScene::createPrototypeMesh(unsigned int prototype) {
+	scenePrototype * proto = &this->prototypes[prototype];
+	RTCGeometry geom = rtcGetGeometry(proto->rtc_scene, 0);
+	const float * vertices = (const float*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+	const unsigned int * indices = (const unsigned int*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_INDEX, 0);
+
+	//GL draws triangles only, so quad meshes are split for the upload
+	std::vector<unsigned int> triangles;
+	size_t triangle_count = proto->primitive_count;
+	if (proto->face_size == 4) {
+		triangles = triangulateQuads(indices, proto->primitive_count);
+		indices = triangles.data();
+		triangle_count = triangles.size() / 3;
 	}
+
+	std::vector<float> normals;
+	if (proto->mesh && proto->mesh->normals.size() >= (size_t)proto->vertex_count * 3) {
+		//Only the upload needs them, so they are taken from the mesh and freed after it
+		normals.swap(proto->mesh->normals);
+	}
+	else {
+		computeVertexNormals(vertices, proto->vertex_count, indices, triangle_count, &normals);
+	}
+	this->memory.parse = std::max(this->memory.parse, normals.size() * sizeof(float) + triangles.size() * sizeof(unsigned int));
+
+	Mesh * mesh = new Mesh(vertices, (size_t)proto->vertex_count * 3, indices, triangle_count * 3, normals.data());
+	this->memory.gl += mesh->getByteSize();
+	return mesh;
+}
+
+void AuralizationScene::rotateObject(unsigned int object, float angle, glm::vec3 axis) {
+	this->objects[object]->rotation = glm::rotate(angle, axis) * this->objects[object]->rotation;
+	setTransform(object, this->objects[object]->getModelMatrix());
 }
 
 void Scene::commitScene() {
+	long long embree_start = beginEmbreeMeasure();
 	rtcCommitScene(this->rtc_scene);
+	endEmbreeMeasure(&this->memory, embree_start);
 }
 
 //void Scene::draw() {
@@ -93,12 +384,78 @@ RTCScene Scene::getRTCScene() {
 	return this->rtc_scene;
 }
 
+unsigned int Scene::hitObject(const RTCHit & hit) {
+	return hit.instID[0] != RTC_INVALID_GEOMETRY_ID ? hit.instID[0] : hit.geomID;
+}
+
+glm::vec3 Scene::hitNormal(const RTCHit & hit) {
+	//Embree reports the normal of instanced geometry in object space
+	glm::vec3 normal = glm::vec3(hit.Ng_x, hit.Ng_y, hit.Ng_z);
+	if (hit.instID[0] != RTC_INVALID_GEOMETRY_ID) {
+		normal = this->instances[hit.instID[0]].normal_transform * normal;
+	}
+	return glm::normalize(normal);
+}
+
+unsigned int Scene::getPrimitive(unsigned int geomID, unsigned int primID, glm::vec3 * vertices) {
+	//The buffers are read through embree, which works both for shared buffers and for the ones embree owns
+	sceneInstance * instance = &this->instances[geomID];
+	scenePrototype * prototype = &this->prototypes[instance->prototype];
+	RTCGeometry geom = rtcGetGeometry(prototype->rtc_scene, 0);
+	float * vertex_buffer = (float*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_VERTEX, 0);
+	unsigned int * face = (unsigned int*)rtcGetGeometryBufferData(geom, RTC_BUFFER_TYPE_INDEX, 0) + primID * prototype->face_size;
+	//Triangles in quad meshes repeat their last vertex
+	unsigned int count = prototype->face_size == 4 && face[2] != face[3] ? 4 : 3;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int vertex_index = face[i];
+		glm::vec4 vertex = glm::vec4(vertex_buffer[vertex_index * 3], vertex_buffer[vertex_index * 3 + 1], vertex_buffer[vertex_index * 3 + 2], 1.0f);
+		vertices[i] = glm::vec3(instance->transform * vertex);
+	}
+	return count;
+}
+
+void Scene::getTriangle(unsigned int geomID, unsigned int primID, glm::vec3 * vertices) {
+	glm::vec3 primitive[SCENE_MAX_PRIMITIVE_VERTICES];
+	getPrimitive(geomID, primID, primitive);
+	for (int i = 0; i < 3; i++) {
+		vertices[i] = primitive[i];
+	}
+}
+
+void Scene::printMemoryReport() {
+	double mb = 1024.0 * 1024.0;
+	//The buffers are allocated through the device too, the rest of embree's memory is the BVHs
+	//Shared buffers are not allocated by embree, so they are not part of its total
+	long long bvh = std::max(this->memory.embree - (long long)(this->memory.buffers - this->memory.shared), 0LL);
+	std::cout << "Scene memory (MB): parse peak " << this->memory.parse / mb << ", geometry buffers " << this->memory.buffers / mb
+		<< " (" << this->memory.shared / mb << " shared with embree), BVH " << bvh / mb << ", GL meshes " << this->memory.gl / mb << std::endl;
+	std::cout << "Embree peak (buffers and BVH build): " << this->memory.embree_peak / mb << " MB" << std::endl;
+}
+
+float Scene::getBoundingVolume() {
+	RTCBounds bounds;
+	rtcGetSceneBounds(this->rtc_scene, &bounds);
+	return glm::max(bounds.upper_x - bounds.lower_x, 0.0f) * glm::max(bounds.upper_y - bounds.lower_y, 0.0f) * glm::max(bounds.upper_z - bounds.lower_z, 0.0f);
+}
+
 Scene::~Scene() {
 	rtcReleaseScene(this->rtc_scene);
+	//The shared buffers can only be freed once embree no longer references them
+	for (int i = 0; i < this->prototypes.size(); ++i) {
+		rtcReleaseScene(this->prototypes[i].rtc_scene);
+		if (this->prototypes[i].mesh) {
+			delete(this->prototypes[i].mesh);
+		}
+	}
 }
 
 AuralizationScene::~AuralizationScene() {
 	for (int i = 0; i < this->objects.size(); ++i) {
 		delete(this->objects[i]);
 	}
+	for (int i = 0; i < this->prototype_meshes.size(); ++i) {
+		if (this->prototype_meshes[i]) {
+			delete(this->prototype_meshes[i]);
+		}
+	}
 }
\ No newline at end of file
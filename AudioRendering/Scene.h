@@ -2,31 +2,144 @@
 
 #include <embree3/rtcore.h>
 #include <embree3/rtcore_common.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
 #include "Mesh.h"
 #include "SceneObject.h"
 
+/*Every object of the scene is an embree instance of a prototype scene that holds its mesh in object space. Moving an
+object only changes its instance transform, so the prototype BVH is kept and only the top level BVH is updated.
+Ray hits report the prototype's geometry in hit.geomID and the object in hit.instID[0]; the rest of the code identifies
+reflectors by object (see hitObject), so "geomID" outside this class is the object's instance ID.
+Objects loaded from the same file share the prototype, so repeated geometry (seats, columns...) is stored and built once.*/
+
+//Primitives are triangles or planar convex quads
+#define SCENE_MAX_PRIMITIVE_VERTICES 4
+
+typedef struct scenePrototype {
+	RTCScene rtc_scene;				//Holds a single geometry (geomID 0) in object space
+	unsigned int face_size;			//Indices per primitive: 3 for triangle meshes, 4 for quad meshes
+	unsigned int primitive_count;
+	unsigned int vertex_count;
+	/*Owner of the vertex and index arrays, which embree uses as shared buffers and the drawn mesh is uploaded from.
+	NULL for large meshes, whose buffers are owned by embree.*/
+	OBJProperites * mesh;
+} scenePrototype;
+
+typedef struct sceneInstance {
+	unsigned int prototype;
+	glm::mat4 transform;			//Object to world
+	glm::mat3 normal_transform;		//Inverse transpose of transform, for the normals
+	bool dynamic;					//Moves while rendering (see Scene::setDynamic)
+} sceneInstance;
+
+class Scene;
+
+//Intersect context whose rays go through the dynamic objects. Initialized by Scene::initStaticContext.
+typedef struct staticIntersectContext {
+	RTCIntersectContext context;	//First member, so embree's filter can get the scene back from it
+	const Scene * scene;
+} staticIntersectContext;
+
+/*Memory used to build the scene, in bytes. Embree's memory is counted by the device's memory monitor (see
+trackDeviceMemory), the scene's part is what it allocates while building its prototypes, instances and BVH.*/
+typedef struct sceneMemory {
+	size_t parse;					//Peak of the temporary memory used to load a file
+	size_t buffers;					//Vertex and index buffers given to embree
+	size_t shared;					//Part of buffers owned by the scene and shared with embree instead of allocated by it
+	size_t gl;						//Buffers uploaded to the GPU for drawing
+	long long embree;				//Allocated by embree for the scene (its buffers and BVHs)
+	long long embree_peak;			//Peak of embree's memory for the scene, including the temporary memory of the builds
+} sceneMemory;
+
 class Scene {
 public:
 	RTCScene rtc_scene;
+	std::vector<scenePrototype> prototypes;
+	//Prototype of every file loaded with addObjectInstance, by prototypeKey
+	std::map<std::string, unsigned int> prototype_files;
+	//Indexed by the instance ID in rtc_scene
+	std::vector<sceneInstance> instances;
+	//Number of primitives (triangles or quads) of each object, indexed by instance ID
+	std::vector<unsigned int> primitive_counts;
+	//Incremented every time a static object moves, so cached results that depend on the static geometry can be invalidated
+	unsigned int geometry_version;
+	//Incremented every time a dynamic object moves
+	unsigned int dynamic_version;
+	//If greater than 0 every mesh is simplified after loading with this geometric tolerance (world units)
+	double simplify_tolerance;
+	/*Large mesh mode: files are streamed straight into embree's buffers and built with a compact BVH, so only one
+	copy of the geometry is kept. Meshes are not simplified in this mode.*/
+	bool compact;
+	//Prints the details of loading the scene (simplification, large meshes, memory)
+	bool verbose;
+	sceneMemory memory;
 
 public:
 	Scene() {};
 	Scene(RTCDevice device);
 	virtual void addObjectFromOBJ(std::string file_name, glm::vec3 pos, float size, RTCDevice * device);
+	//Adds an object that shares its mesh with every other object loaded from file_name. Returns its instance ID.
+	virtual unsigned int addObjectInstance(std::string file_name, glm::vec3 pos, float size, glm::mat4 rotation, RTCDevice * device);
+	/*Key of file_name in prototype_files. Simplified meshes depend on the scale the tolerance is applied at, so then each
+	size has its own prototype.*/
+	std::string prototypeKey(std::string file_name, float size);
+	//Loads an OBJ that will be scaled by size, simplifying it if simplify_tolerance is set. The caller owns the result.
+	OBJProperites * loadMesh(std::string file_name, float size);
+	//Creates a prototype scene with mesh, which is shared with embree and owned by the scene from now on. Returns its index in prototypes.
+	unsigned int addPrototype(OBJProperites * mesh, RTCDevice * device);
+	//Creates a compact prototype parsing file_name directly into embree's buffers. Returns its index in prototypes.
+	unsigned int addCompactPrototype(std::string file_name, RTCDevice * device);
+	//Loads file_name as a shared or a compact prototype depending on the mode. Returns its index in prototypes.
+	unsigned int loadPrototype(std::string file_name, float size, RTCDevice * device);
+	//Adds an instance of prototype to the scene. Returns its instance ID.
+	unsigned int addInstance(unsigned int prototype, glm::mat4 transform, RTCDevice * device);
+	//Moves an object. commitScene has to be called before tracing again.
+	void setTransform(unsigned int instance, glm::mat4 transform);
+	/*Marks an object that moves while rendering. Results cached across frames (image source trees, radiance transfer)
+	are computed without the dynamic objects, so moving them doesn't invalidate those results.*/
+	void setDynamic(unsigned int instance);
+	bool isDynamic(unsigned int instance) const;
+	//Initializes context so the rays intersected with it ignore the dynamic objects
+	void initStaticContext(staticIntersectContext * context);
 	void commitScene();
 	RTCScene getRTCScene();
+	//Object that was hit (instance ID). RTC_INVALID_GEOMETRY_ID if nothing was hit.
+	unsigned int hitObject(const RTCHit & hit);
+	//World space normalized geometry normal of the hit
+	glm::vec3 hitNormal(const RTCHit & hit);
+	//Writes the world space vertices of primitive primID of object geomID in vertices, which must fit SCENE_MAX_PRIMITIVE_VERTICES. Returns how many there are.
+	unsigned int getPrimitive(unsigned int geomID, unsigned int primID, glm::vec3 * vertices);
+	//Writes the first three world space vertices of primitive primID of object geomID in vertices[0..2]. For quads they span its plane.
+	void getTriangle(unsigned int geomID, unsigned int primID, glm::vec3 * vertices);
+	//Prints the memory breakdown of the scene. Call it after commitScene so the BVH is built.
+	void printMemoryReport();
+	//Volume of the bounding box of the committed scene. An upper bound of the volume of the room.
+	float getBoundingVolume();
 	~Scene();
 };
 
+//Registers a memory monitor on device so the memory used by embree (buffers and BVHs) can be reported. Scenes using it must be built one at a time.
+void trackDeviceMemory(RTCDevice device);
+
 class AuralizationScene : public Scene{
 public:
 	//std::vector<Mesh*> meshes;
 	std::vector<SceneObject*> objects;
+	//Drawn mesh of each prototype, shared by its objects
+	std::vector<Mesh*> prototype_meshes;
 
 public:
 	AuralizationScene() {};
 	AuralizationScene(RTCDevice device);
 	//Scene(std::string file_name, RTCDevice device);
 	void addObjectFromOBJ(std::string file_name, glm::vec3 pos, float size, RTCDevice * device);
+	unsigned int addObjectInstance(std::string file_name, glm::vec3 pos, float size, glm::mat4 rotation, RTCDevice * device);
+	/*Drawn mesh of a prototype, uploaded from the same buffers embree traces. The normals are only needed for the upload,
+	so they are freed after it. Large meshes have no normals, they are computed from the faces.*/
+	Mesh * createPrototypeMesh(unsigned int prototype);
+	//Rotates object around its position. Updates both the drawn mesh and the embree instance.
+	void rotateObject(unsigned int object, float angle, glm::vec3 axis);
 	~AuralizationScene();
 };
\ No newline at end of file
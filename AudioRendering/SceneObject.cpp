@@ -1,9 +1,23 @@
 #include "SceneObject.h"
 
-SceneObject::SceneObject(glm::vec3 pos, float size, OBJProperites props) {
-	this->mesh = new Mesh(props.vertices, props.indices, props.normals);
+SceneObject::SceneObject(glm::vec3 pos, float size, const OBJProperites & props) {
+	//GL draws triangles only
+	if (props.quads) {
+		this->mesh = new Mesh(props.vertices, triangulateQuads(props.indices.data(), props.indices.size() / 4), props.normals.data());
+	}
+	else {
+		this->mesh = new Mesh(props.vertices, props.indices, props.normals.data());
+	}
 	this->pos = pos;
 	this->size = size;
+	this->rotation = glm::mat4(1.0f);
+}
+
+SceneObject::SceneObject(glm::vec3 pos, float size, Mesh * mesh) {
+	this->mesh = mesh;
+	this->pos = pos;
+	this->size = size;
+	this->rotation = glm::mat4(1.0f);
 }
 
 void SceneObject::draw() {
@@ -11,7 +25,7 @@ void SceneObject::draw() {
 }
 
 glm::mat4x4 SceneObject::getModelMatrix() {
-	return glm::translate(this->pos) * glm::scale(glm::vec3(this->size));
+	return glm::translate(this->pos) * this->rotation * glm::scale(glm::vec3(this->size));
 }
 
 SceneObject::~SceneObject(){
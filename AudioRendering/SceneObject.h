@@ -11,9 +11,13 @@ public:
 	Mesh * mesh;
 	glm::vec3 pos;
 	float size;
+	//Applied around pos, identity unless the object is animated
+	glm::mat4 rotation;
 
 public:
-	SceneObject(glm::vec3 pos, float size, OBJProperites props);
+	SceneObject(glm::vec3 pos, float size, const OBJProperites & props);
+	//The mesh is shared with other objects and is not owned by this one
+	SceneObject(glm::vec3 pos, float size, Mesh * mesh);
 	void draw();
 	glm::mat4x4 getModelMatrix();
 	~SceneObject();
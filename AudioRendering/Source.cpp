@@ -7,7 +7,11 @@ Source::Source(glm::vec3 position, float radius, std::string file_name) {
 	this->pos = position;
 	this->sphere_radius = radius;
 	OBJProperites props = loadOBJ(file_name);
-	this->mesh = new Mesh(props.vertices, props.indices, props.normals);
+	//GL draws triangles only
+	if (props.quads) {
+		props.indices = triangulateQuads(props.indices.data(), props.indices.size() / 4);
+	}
+	this->mesh = new Mesh(props.vertices, props.indices, props.normals.data());
 }
 
 glm::mat4x4 Source::getModelMatrix() {
@@ -0,0 +1,80 @@
+#include "SpecularPathFinder.h"
+
+SpecularPathFinder::SpecularPathFinder(Scene * scene, float source_power, int max_order, float reflexion_coef) {
+	this->scene = scene;
+	this->source_power = source_power;
+	this->max_order = max_order;
+	this->reflexion_coef = reflexion_coef;
+	this->discovery_divisor = 1;
+}
+
+void SpecularPathFinder::attach(RayTracer * rt) {
+	rt->specular_order = this->max_order;
+	rt->specular_sequences = &this->sequences;
+	rt->specular_discovery_rays = rt->num_rays / this->discovery_divisor;
+	this->sequences.set.clear();
+}
+
+bool SpecularPathFinder::computePath(const reflectorSequence & sequence, glm::vec3 source_pos, glm::vec3 listener_pos, audioPath * path) {
+	int order = sequence.size();
+	std::vector<glm::vec3> images(order + 1);
+	images[0] = source_pos;
+	for (int k = 1; k <= order; k++) {
+		glm::vec3 triangle[3];
+		this->scene->getTriangle(sequence[k - 1].geomID, sequence[k - 1].primID, triangle);
+		images[k] = mirrorPoint(images[k - 1], triangle);
+	}
+	if (!isSpecularPathValid(this->scene, images, sequence, listener_pos)) {
+		return false;
+	}
+
+	float distance = glm::length(listener_pos - images[order]);
+	path->travelled_distance = distance;
+	path->remaining_energy_factor = specularPathEnergy(this->source_power, this->reflexion_coef, order, distance);
+	path->is_direct_path = order == 0;
+	path->reflection_order = order;
+	return true;
+}
+
+void SpecularPathFinder::render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths) {
+	int new_sequences = 0;
+	for (auto it = this->sequences.set.begin(); it != this->sequences.set.end(); ++it) {
+		if (this->cache.emplace(*it, 0).second) {
+			new_sequences++;
+		}
+	}
+	this->sequences.set.clear();
+	//While the cache keeps growing every ray looks for sequences. Once it is complete less rays are needed to find the missing ones.
+	if (new_sequences > 0) {
+		this->discovery_divisor = 1;
+	}
+	else {
+		this->discovery_divisor = glm::min(this->discovery_divisor * 2, SPECULAR_PATH_MIN_DISCOVERY_DIVISOR);
+	}
+
+	for (auto it = this->cache.begin(); it != this->cache.end();) {
+		audioPath path;
+		//A ray can reach the listener sphere following a sequence whose exact path misses the listener's center
+		if (computePath(it->first, source_pos, listener_pos, &path)) {
+			addAudioPath(paths, path);
+			it->second = 0;
+			++it;
+		}
+		else if (++it->second > SPECULAR_PATH_MAX_MISSES) {
+			it = this->cache.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void SpecularPathFinder::clear() {
+	this->sequences.set.clear();
+	this->cache.clear();
+	this->discovery_divisor = 1;
+}
+
+SpecularPathFinder::~SpecularPathFinder() {
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+/*Ray guided specular path finder. Many of the rays that reach the listener follow the same sequence of reflectors.
+The ray tracer records the sequence of every ray that reaches the listener with up to max_order reflections and
+the repeated ones are discarded. For every unique sequence the exact path is computed with image sources, so the
+early part of the response has exact discrete arrivals instead of the noisy stochastic ones.
+
+The sequences are kept between renders. When the listener or the source moves most of them are still valid, so every
+render recomputes and revalidates the cached ones and the ray tracer only has to discover the missing ones.*/
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+#include "Scene.h"
+#include "AudioRenderingUtils.h"
+#include "ImageSource.h"
+
+//A cached sequence is dropped after being invalid in this many consecutive renders
+#define SPECULAR_PATH_MAX_MISSES 8
+//While no new sequences are found the discovery rays are halved every render, down to num_rays / this
+#define SPECULAR_PATH_MIN_DISCOVERY_DIVISOR 16
+
+class SpecularPathFinder {
+public:
+	Scene * scene;
+	float source_power;
+	int max_order;
+	float reflexion_coef;
+	//Unique sequences found by the ray tracer in the current render
+	specularSequences sequences;
+	//Every sequence found so far and the number of consecutive renders in which it was not valid
+	std::unordered_map<reflectorSequence, int, reflectorSequenceHash> cache;
+	//Fraction of the rays that record their sequence is 1 / discovery_divisor
+	int discovery_divisor;
+
+public:
+	SpecularPathFinder(Scene * scene, float source_power, int max_order, float reflexion_coef);
+
+	//Sets up the ray tracer so it records the sequences instead of storing the stochastic paths. Must be called before every cast.
+	void attach(RayTracer * rt);
+
+	//Computes the exact path that follows sequence. Returns false if the path is not valid for these positions.
+	bool computePath(const reflectorSequence & sequence, glm::vec3 source_pos, glm::vec3 listener_pos, audioPath * path);
+
+	//Adds the sequences found by the last cast to the cache and adds to paths the exact path of every cached sequence that is valid
+	void render(glm::vec3 source_pos, glm::vec3 listener_pos, audioPaths * paths);
+
+	void clear();
+	~SpecularPathFinder();
+};
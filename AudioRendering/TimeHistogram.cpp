@@ -0,0 +1,60 @@
+#include "TimeHistogram.h"
+
+#include <algorithm>
+
+TimeHistogram::TimeHistogram() {
+	this->size = 0;
+	this->fine_size = 0;
+}
+
+void TimeHistogram::resize(size_t size, size_t fine_size) {
+	this->size = size;
+	this->fine_size = fine_size >= size ? 0 : fine_size;
+	this->bins.assign(this->fine_size ? binIndex(size - 1) + 1 : size, 0.0);
+}
+
+void TimeHistogram::clear() {
+	std::fill(this->bins.begin(), this->bins.end(), 0.0);
+}
+
+size_t TimeHistogram::binIndex(size_t sample) const {
+	if (!this->fine_size) {
+		return sample;
+	}
+	//Level k covers the samples from fine_size * (2^k - 1) to fine_size * (2^(k+1) - 1)
+	size_t octave = sample / this->fine_size + 1;
+	int level = 0;
+	while (octave >> (level + 1)) {
+		level++;
+	}
+	size_t level_start = this->fine_size * (((size_t)1 << level) - 1);
+	return level * this->fine_size + ((sample - level_start) >> level);
+}
+
+void TimeHistogram::accumulate(const TimeHistogram & other) {
+	size_t count = std::min(this->bins.size(), other.bins.size());
+	for (size_t i = 0; i < count; i++) {
+		this->bins[i] += other.bins[i];
+	}
+}
+
+void TimeHistogram::expand(std::vector<float> * dense) const {
+	size_t size = std::min(this->size, dense->size());
+	if (!this->fine_size) {
+		for (size_t i = 0; i < size; i++) {
+			(*dense)[i] += (float)this->bins[i];
+		}
+		return;
+	}
+	size_t start = 0;
+	for (size_t bin = 0; bin < this->bins.size() && start < size; bin++) {
+		size_t width = (size_t)1 << (bin / this->fine_size);
+		//The last bin may be cut by the end of the histogram
+		size_t covered = std::min(width, this->size - start);
+		float energy = (float)(this->bins[bin] / covered);
+		for (size_t i = start; i < std::min(start + covered, size); i++) {
+			(*dense)[i] += energy;
+		}
+		start += width;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+/*Energy histogram of arrival times with fine bins early and coarser bins later. The first fine_size samples have a bin
+each, and after them come levels of fine_size bins where every level has bins twice as wide as the previous one. Level k
+starts at sample fine_size * (2^k - 1), so 1 s at 48 kHz with 100 ms of fine bins needs 16200 bins instead of 48000: three
+full levels of 4800 bins and 1800 bins of the fourth one, 8 samples wide.
+
+The early part keeps the sample accuracy of the reflections while the smooth late decay only needs its envelope. A
+fine_size of 0 (or one that covers size) is a plain dense histogram.
+
+Bins are doubles: a float bin stops growing once it is about 10^7 times the energy of one path, which long runs reach.*/
+
+#include <vector>
+#include <cstddef>
+
+class TimeHistogram {
+public:
+	size_t size;			//Samples covered
+	size_t fine_size;		//Bins per level
+	std::vector<double> bins;
+
+public:
+	TimeHistogram();
+	void resize(size_t size, size_t fine_size);
+	void clear();
+	//Bin of a sample < size
+	size_t binIndex(size_t sample) const;
+	void add(size_t sample, float energy) {
+		if (sample < this->size) {
+			this->bins[binIndex(sample)] += energy;
+		}
+	}
+	//Adds the bins of other, which must have the same layout
+	void accumulate(const TimeHistogram & other);
+	//Adds the histogram to a dense one of one bin per sample. The energy of a coarse bin is spread evenly over its
+	//samples, so every bin keeps its energy and the fine part is copied as it is.
+	void expand(std::vector<float> * dense) const;
+};
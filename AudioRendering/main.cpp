@@ -16,6 +16,12 @@
 #include <stdio.h>
 #include <math.h>
 #include <limits>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <atomic>
+#include <thread>
 
 #include "Scene.h"
 #include "AudioRenderer.h"
@@ -40,6 +46,163 @@ SDL_GLContext context;
 int WIDTH = 800;
 int HEIGHT = 600;
 
+//Object that rotates around its position during the auralization
+typedef struct movingObject {
+	unsigned int object;
+	glm::vec3 axis;
+	float speed;		//Degrees per second
+} movingObject;
+
+/*Adds the OBJECT entries of the scene file to scene. Entries with the same MODEL are instances of a single mesh, so
+repeated geometry (seats, columns, panels...) is loaded and built once.*/
+void addObjects(tinyxml2::XMLDocument * scene_doc, Scene * scene, RTCDevice * device) {
+	for (tinyxml2::XMLElement * element = scene_doc->FirstChildElement("SCENE")->FirstChildElement("OBJECT"); element; element = element->NextSiblingElement("OBJECT")) {
+		glm::vec3 pos = glm::vec3(
+			element->FirstChildElement("POS_X")->FloatText(),
+			element->FirstChildElement("POS_Y")->FloatText(),
+			element->FirstChildElement("POS_Z")->FloatText()
+		);
+		//Optional rotation in degrees around x, then y, then z
+		glm::mat4 rotation = glm::mat4(1.0f);
+		if (element->FirstChildElement("ROTATION_Z")) {
+			rotation = glm::rotate(glm::radians(element->FirstChildElement("ROTATION_Z")->FloatText()), glm::vec3(0, 0, 1)) * rotation;
+		}
+		if (element->FirstChildElement("ROTATION_Y")) {
+			rotation = glm::rotate(glm::radians(element->FirstChildElement("ROTATION_Y")->FloatText()), glm::vec3(0, 1, 0)) * rotation;
+		}
+		if (element->FirstChildElement("ROTATION_X")) {
+			rotation = glm::rotate(glm::radians(element->FirstChildElement("ROTATION_X")->FloatText()), glm::vec3(1, 0, 0)) * rotation;
+		}
+		float size = element->FirstChildElement("SIZE") ? element->FirstChildElement("SIZE")->FloatText() : 1.0f;
+		scene->addObjectInstance(element->FirstChildElement("MODEL")->GetText(), pos, size, rotation, device);
+	}
+}
+
+//Adds the MOVING_OBJECT entries of the scene file to scene and returns them
+std::vector<movingObject> addMovingObjects(tinyxml2::XMLDocument * scene_doc, AuralizationScene * scene, RTCDevice * device) {
+	std::vector<movingObject> moving_objects;
+	for (tinyxml2::XMLElement * element = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MOVING_OBJECT"); element; element = element->NextSiblingElement("MOVING_OBJECT")) {
+		glm::vec3 pos = glm::vec3(
+			element->FirstChildElement("POS_X")->FloatText(),
+			element->FirstChildElement("POS_Y")->FloatText(),
+			element->FirstChildElement("POS_Z")->FloatText()
+		);
+		glm::vec3 axis = glm::vec3(
+			element->FirstChildElement("AXIS_X")->FloatText(),
+			element->FirstChildElement("AXIS_Y")->FloatText(),
+			element->FirstChildElement("AXIS_Z")->FloatText()
+		);
+		unsigned int object = scene->addObjectInstance(element->FirstChildElement("MODEL")->GetText(), pos, element->FirstChildElement("SIZE")->FloatText(), glm::mat4(1.0f), device);
+		scene->setDynamic(object);
+		moving_objects.push_back({ object, glm::normalize(axis), element->FirstChildElement("SPEED")->FloatText() });
+	}
+	return moving_objects;
+}
+
+//Sets how the meshes of the SCENE element root are loaded: SIMPLIFY, LARGE_MESH and VERBOSE
+void parseLoadOptions(tinyxml2::XMLElement * root, Scene * scene) {
+	if (root->FirstChildElement("SIMPLIFY")) {
+		scene->simplify_tolerance = root->FirstChildElement("SIMPLIFY")->FirstChildElement("TOLERANCE")->DoubleText();
+	}
+	if (root->FirstChildElement("LARGE_MESH")) {
+		scene->compact = root->FirstChildElement("LARGE_MESH")->BoolText();
+	}
+	if (root->FirstChildElement("VERBOSE")) {
+		scene->verbose = root->FirstChildElement("VERBOSE")->BoolText();
+	}
+}
+
+//Engines of the optional elements of a simulation file. Each one is NULL if its element is not in the file.
+typedef struct simulationEngines {
+	ImageSourceTracer * image_sources;
+	BeamTracer * beam_tracer;
+	SpecularPathFinder * specular_paths;
+	PathGuide * path_guide;
+	AcousticRadianceTransfer * late_field;
+	BidirectionalPathTracer * bidirectional;
+	PressureSynthesizer * synthesis;
+	HybridReverb * hybrid_reverb;
+} simulationEngines;
+
+ImageSourceTracer * parseImageSources(tinyxml2::XMLElement * element, Scene * scene, float source_power, float absorbtion_coef) {
+	int max_order = element->FirstChildElement("MAX_ORDER")->IntText();
+	int visibility_rays = element->FirstChildElement("VISIBILITY_RAYS") ? element->FirstChildElement("VISIBILITY_RAYS")->IntText() : IMAGE_SOURCE_VISIBILITY_RAYS;
+	return new ImageSourceTracer(scene, source_power, max_order, 1 - absorbtion_coef, visibility_rays);
+}
+
+BeamTracer * parseBeamTracer(tinyxml2::XMLElement * element, Scene * scene, float source_power, float absorbtion_coef) {
+	int max_order = element->FirstChildElement("MAX_ORDER")->IntText();
+	int subdivisions = element->FirstChildElement("SUBDIVISIONS") ? element->FirstChildElement("SUBDIVISIONS")->IntText() : BEAM_TRACING_SUBDIVISIONS;
+	int max_splits = element->FirstChildElement("MAX_SPLITS") ? element->FirstChildElement("MAX_SPLITS")->IntText() : BEAM_TRACING_MAX_SPLITS;
+	return new BeamTracer(scene, source_power, max_order, 1 - absorbtion_coef, subdivisions, max_splits);
+}
+
+SpecularPathFinder * parseSpecularPaths(tinyxml2::XMLElement * element, Scene * scene, float source_power, float absorbtion_coef) {
+	int max_order = element->FirstChildElement("MAX_ORDER")->IntText();
+	return new SpecularPathFinder(scene, source_power, max_order, 1 - absorbtion_coef);
+}
+
+PathGuide * parsePathGuide(tinyxml2::XMLElement * element) {
+	int iterations = element->FirstChildElement("ITERATIONS") ? element->FirstChildElement("ITERATIONS")->IntText() : PATH_GUIDE_ITERATIONS;
+	return new PathGuide(iterations);
+}
+
+AcousticRadianceTransfer * parseRadianceTransfer(tinyxml2::XMLElement * element, Scene * scene, float source_power, float absorbtion_coef) {
+	float start_time = element->FirstChildElement("START")->FloatText() / 1000;
+	float patch_area = element->FirstChildElement("PATCH_AREA") ? element->FirstChildElement("PATCH_AREA")->FloatText() : RADIANCE_TRANSFER_PATCH_AREA;
+	int rays = element->FirstChildElement("RAYS") ? element->FirstChildElement("RAYS")->IntText() : RADIANCE_TRANSFER_RAYS;
+	int bin_rate = element->FirstChildElement("BIN_RATE") ? element->FirstChildElement("BIN_RATE")->IntText() : RADIANCE_TRANSFER_BIN_RATE;
+	return new AcousticRadianceTransfer(scene, source_power, 1 - absorbtion_coef, patch_area, rays, bin_rate, start_time);
+}
+
+BidirectionalPathTracer * parseBidirectional(tinyxml2::XMLElement * element) {
+	float scattering = element->FirstChildElement("SCATTERING")->FloatText();
+	int num_paths = element->FirstChildElement("PATHS") ? element->FirstChildElement("PATHS")->IntText() : 0;
+	return new BidirectionalPathTracer(scattering, num_paths);
+}
+
+PressureSynthesizer * parseSynthesis(tinyxml2::XMLElement * element, Scene * scene) {
+	float bin_length = element->FirstChildElement("BIN_LENGTH") ? element->FirstChildElement("BIN_LENGTH")->FloatText() : SYNTHESIS_BIN_LENGTH;
+	float max_density = element->FirstChildElement("MAX_DENSITY") ? element->FirstChildElement("MAX_DENSITY")->FloatText() : SYNTHESIS_MAX_DENSITY;
+	float volume = scene->getBoundingVolume();
+	if (element->FirstChildElement("MIXING_TIME")) {
+		return new PressureSynthesizer(volume, bin_length, max_density, element->FirstChildElement("MIXING_TIME")->FloatText());
+	}
+	return new PressureSynthesizer(volume, bin_length, max_density);
+}
+
+HybridReverb * parseHybridReverb(tinyxml2::XMLElement * element) {
+	float echo_density = element->FirstChildElement("ECHO_DENSITY") ? element->FirstChildElement("ECHO_DENSITY")->FloatText() : HYBRID_ECHO_DENSITY;
+	float pilot_fraction = element->FirstChildElement("PILOT_FRACTION") ? element->FirstChildElement("PILOT_FRACTION")->FloatText() : HYBRID_PILOT_FRACTION;
+	return new HybridReverb(echo_density, pilot_fraction);
+}
+
+//Creates the engines of the optional elements of the SCENE element root. The scene must be committed.
+simulationEngines parseEngines(tinyxml2::XMLElement * root, Scene * scene, float source_power, float absorbtion_coef) {
+	simulationEngines engines;
+	engines.image_sources = root->FirstChildElement("IMAGE_SOURCE") ? parseImageSources(root->FirstChildElement("IMAGE_SOURCE"), scene, source_power, absorbtion_coef) : NULL;
+	//Both compute the same early reflections, so beams are only traced without image sources
+	engines.beam_tracer = !engines.image_sources && root->FirstChildElement("BEAM_TRACING") ? parseBeamTracer(root->FirstChildElement("BEAM_TRACING"), scene, source_power, absorbtion_coef) : NULL;
+	engines.specular_paths = root->FirstChildElement("SPECULAR_PATHS") ? parseSpecularPaths(root->FirstChildElement("SPECULAR_PATHS"), scene, source_power, absorbtion_coef) : NULL;
+	engines.path_guide = root->FirstChildElement("PATH_GUIDING") ? parsePathGuide(root->FirstChildElement("PATH_GUIDING")) : NULL;
+	engines.late_field = root->FirstChildElement("RADIANCE_TRANSFER") ? parseRadianceTransfer(root->FirstChildElement("RADIANCE_TRANSFER"), scene, source_power, absorbtion_coef) : NULL;
+	engines.bidirectional = root->FirstChildElement("BIDIRECTIONAL") ? parseBidirectional(root->FirstChildElement("BIDIRECTIONAL")) : NULL;
+	engines.synthesis = root->FirstChildElement("SYNTHESIS") ? parseSynthesis(root->FirstChildElement("SYNTHESIS"), scene) : NULL;
+	engines.hybrid_reverb = root->FirstChildElement("HYBRID_REVERB") ? parseHybridReverb(root->FirstChildElement("HYBRID_REVERB")) : NULL;
+	return engines;
+}
+
+void deleteEngines(simulationEngines * engines) {
+	delete(engines->image_sources);
+	delete(engines->beam_tracer);
+	delete(engines->specular_paths);
+	delete(engines->path_guide);
+	delete(engines->late_field);
+	delete(engines->bidirectional);
+	delete(engines->synthesis);
+	delete(engines->hybrid_reverb);
+}
+
 /*
  * A minimal tutorial.
  *
@@ -99,6 +262,7 @@ RTCDevice initializeDevice()
 		printf("error %d: cannot create device\n", rtcGetDeviceError(NULL));
 
 	rtcSetDeviceErrorFunction(device, errorFunction, NULL);
+	trackDeviceMemory(device);
 	return device;
 }
 
@@ -200,6 +364,14 @@ void auralize(char* file_path) {
 	);
 
 	float listener_size = scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("SIZE")->FloatText();
+	bool adaptive_listener = false;
+	if (scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("ADAPTIVE")) {
+		adaptive_listener = scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("ADAPTIVE")->BoolText();
+	}
+	unsigned int fine_length = 0;
+	if (scene_doc.FirstChildElement("SCENE")->FirstChildElement("MULTIRESOLUTION")) {
+		fine_length = scene_doc.FirstChildElement("SCENE")->FirstChildElement("MULTIRESOLUTION")->UnsignedText();
+	}
 	glm::vec3 listener_pos = glm::vec3(
 		scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_X")->FloatText(),
 		scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Y")->FloatText(),
@@ -214,8 +386,16 @@ void auralize(char* file_path) {
 		sample_rate = SAMPLE_RATE;
 	}
 
+	parseLoadOptions(scene_doc.FirstChildElement("SCENE"), scene);
 	scene->addObjectFromOBJ(model_file_path, glm::vec3(0.0f, 0.0f, 0.0f), scene_size, &device);
+	addObjects(&scene_doc, scene, &device);
+	std::vector<movingObject> moving_objects = addMovingObjects(&scene_doc, scene, &device);
 	scene->commitScene();
+	if (scene->verbose) {
+		scene->printMemoryReport();
+	}
+
+	simulationEngines engines = parseEngines(scene_doc.FirstChildElement("SCENE"), scene, source_power, absorbtion_coef);
 
 	const char * sound_sample = NULL;
 	AudioRenderer audio;
@@ -226,6 +406,16 @@ void auralize(char* file_path) {
 	else {
 		audio = AudioRenderer(max_reflexions, absorbtion_coef, num_rays, source_power, listener_size, sample_rate);
 	}
+	audio.adaptive_listener = adaptive_listener;
+	audio.fine_length = fine_length;
+	audio.image_sources = engines.image_sources;
+	audio.beam_tracer = engines.beam_tracer;
+	audio.specular_paths = engines.specular_paths;
+	audio.path_guide = engines.path_guide;
+	audio.late_field = engines.late_field;
+	audio.bidirectional = engines.bidirectional;
+	audio.synthesis = engines.synthesis;
+	audio.hybrid_reverb = engines.hybrid_reverb;
 	Camera cam = Camera(listener_pos, WIDTH, HEIGHT, 45, window);
 	Source * source = new Source(glm::vec3(0.0f, 0.0f, 0.0f), 0.25, "assets/models/sphere.obj");
 	audio.render(scene, &cam, source);
@@ -289,6 +479,14 @@ void auralize(char* file_path) {
 			}
 		}
 
+		//Moving an object only updates its instance transform, so the scene commit only rebuilds the top level BVH
+		if (!moving_objects.empty()) {
+			for (int i = 0; i < moving_objects.size(); ++i) {
+				scene->rotateObject(moving_objects[i].object, glm::radians(moving_objects[i].speed) * frameTime / 1000, moving_objects[i].axis);
+			}
+			scene->commitScene();
+		}
+
 		cam.update();
 		if (active_rendering) {
 			audio.render(scene, &cam, source);
@@ -322,6 +520,7 @@ void auralize(char* file_path) {
 		SDL_GL_SwapWindow(window);
 	}
 
+	deleteEngines(&engines);
 	delete(scene);
 	/* Though not strictly necessary in this example, you should
 	/* always make sure to release resources allocated through Embree. */
@@ -332,54 +531,294 @@ void auralize(char* file_path) {
 	close();
 }
 
-void getFileImpulseResponse(char* file_path) {
-	tinyxml2::XMLDocument scene_doc;
+//Builds and commits the scene of a simulation file: MODEL at SIZE, the OBJECT entries, SIMPLIFY, LARGE_MESH and VERBOSE
+Scene * loadSimulationScene(tinyxml2::XMLDocument * scene_doc, RTCDevice * device) {
+	const char* model_file_path = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MODEL")->GetText();
+	float scene_size = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SIZE")->FloatText();
 
-	if (scene_doc.LoadFile(file_path)) {
-		cout << "Error loading file" << endl;
+	Scene * scene = new Scene(*device);
+	parseLoadOptions(scene_doc->FirstChildElement("SCENE"), scene);
+	scene->addObjectFromOBJ(model_file_path, glm::vec3(0.0f, 0.0f, 0.0f), scene_size, device);
+	addObjects(scene_doc, scene, device);
+	scene->commitScene();
+	if (scene->verbose) {
+		scene->printMemoryReport();
+	}
+	return scene;
+}
+
+//FNV-1a of the simulation file, so a checkpoint or a partial result of another simulation can be told apart
+unsigned long long configHash(tinyxml2::XMLDocument * scene_doc) {
+	//The compact print leaves out the formatting of the file
+	tinyxml2::XMLPrinter printer(NULL, true);
+	scene_doc->Print(&printer);
+	unsigned long long hash = 14695981039346656037ULL;
+	for (const char * c = printer.CStr(); *c; c++) {
+		hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*If SIMPLIFY has COMPARE, builds the scene of a simulation file without simplifying it and compares it with scene.
+Building a scene measures the memory of the whole device, so this can't run while other scenes are built.*/
+void compareSimplification(tinyxml2::XMLDocument * scene_doc, Scene * scene, RTCDevice * device) {
+	tinyxml2::XMLElement * simplify_element = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SIMPLIFY");
+	if (!simplify_element || !simplify_element->FirstChildElement("COMPARE") || !simplify_element->FirstChildElement("COMPARE")->BoolText()) {
 		return;
 	}
+	const char* model_file_path = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MODEL")->GetText();
+	float scene_size = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SIZE")->FloatText();
+	int max_reflexions = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MAX_REFLEXIONS")->IntText();
+	float absorbtion_coef = scene_doc->FirstChildElement("SCENE")->FirstChildElement("ABSORBTION")->FloatText();
+	long long num_rays = scene_doc->FirstChildElement("SCENE")->FirstChildElement("NUM_RAYS")->Int64Text();
+	float source_power = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POWER")->FloatText();
+	glm::vec3 source_pos = glm::vec3(
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_X")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Y")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Z")->FloatText()
+	);
+	float listener_size = scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("SIZE")->FloatText();
+	glm::vec3 listener_pos = glm::vec3(
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_X")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Y")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Z")->FloatText()
+	);
 
-	const char* model_file_path = scene_doc.FirstChildElement("SCENE")->FirstChildElement("MODEL")->GetText();
-	float scene_size = scene_doc.FirstChildElement("SCENE")->FirstChildElement("SIZE")->FloatText();
-	int max_reflexions = scene_doc.FirstChildElement("SCENE")->FirstChildElement("MAX_REFLEXIONS")->IntText();
-	float absorbtion_coef = scene_doc.FirstChildElement("SCENE")->FirstChildElement("ABSORBTION")->FloatText();
-	int num_rays = scene_doc.FirstChildElement("SCENE")->FirstChildElement("NUM_RAYS")->IntText();
+	Scene * original = new Scene(*device);
+	original->addObjectFromOBJ(model_file_path, glm::vec3(0.0f, 0.0f, 0.0f), scene_size, device);
+	addObjects(scene_doc, original, device);
+	original->commitScene();
+	compareScenes(original, scene, listener_pos, listener_size, source_pos, source_power, max_reflexions, absorbtion_coef, (int)std::min(num_rays, (long long)std::numeric_limits<int>::max()));
+	delete(original);
+}
 
-	float source_power = scene_doc.FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POWER")->FloatText();
+/*Simulates the impulse response of a simulation file in an already loaded scene and writes Rs to output_path. The scene
+is only read, so several simulations can share it at the same time. If shard is set only its rays are cast and the
+partial result is written to output_path instead.*/
+void simulateScene(tinyxml2::XMLDocument * scene_doc, Scene * scene, const std::string & output_path, int num_threads, const std::vector<reweightSetting> & reweights, bool calibrate, const shardSetting * shard) {
+	int max_reflexions = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MAX_REFLEXIONS")->IntText();
+	float absorbtion_coef = scene_doc->FirstChildElement("SCENE")->FirstChildElement("ABSORBTION")->FloatText();
+	long long num_rays = scene_doc->FirstChildElement("SCENE")->FirstChildElement("NUM_RAYS")->Int64Text();
+
+	float source_power = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POWER")->FloatText();
 	glm::vec3 source_pos = glm::vec3(
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_X")->FloatText(),
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Y")->FloatText(),
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Z")->FloatText()
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_X")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Y")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("SOURCE")->FirstChildElement("POS_Z")->FloatText()
 	);
 
-	float listener_size = scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("SIZE")->FloatText();
+	float listener_size = scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("SIZE")->FloatText();
+	bool adaptive_listener = false;
+	if (scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("ADAPTIVE")) {
+		adaptive_listener = scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("ADAPTIVE")->BoolText();
+	}
+	unsigned int fine_length = 0;
+	if (scene_doc->FirstChildElement("SCENE")->FirstChildElement("MULTIRESOLUTION")) {
+		fine_length = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MULTIRESOLUTION")->UnsignedText();
+	}
+	//Negative to take it from the clock
+	long long seed = -1;
+	if (scene_doc->FirstChildElement("SCENE")->FirstChildElement("SEED")) {
+		seed = scene_doc->FirstChildElement("SCENE")->FirstChildElement("SEED")->Int64Text();
+	}
+	checkpointSetting * checkpoint = NULL;
+	if (scene_doc->FirstChildElement("SCENE")->FirstChildElement("CHECKPOINT")) {
+		tinyxml2::XMLElement * checkpoint_element = scene_doc->FirstChildElement("SCENE")->FirstChildElement("CHECKPOINT");
+		checkpoint = new checkpointSetting();
+		checkpoint->file_path = checkpoint_element->FirstChildElement("FILE")->GetText();
+		checkpoint->interval = checkpoint_element->FirstChildElement("INTERVAL") ? checkpoint_element->FirstChildElement("INTERVAL")->Int64Text() : CHECKPOINT_INTERVAL;
+		//Shards of the same simulation can run on the same machine
+		if (shard) {
+			checkpoint->file_path += "_" + std::to_string(shard->first_ray);
+		}
+	}
 	glm::vec3 listener_pos = glm::vec3(
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_X")->FloatText(),
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Y")->FloatText(),
-		scene_doc.FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Z")->FloatText()
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_X")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Y")->FloatText(),
+		scene_doc->FirstChildElement("SCENE")->FirstChildElement("LISTENER")->FirstChildElement("POS_Z")->FloatText()
 	);
 
-	RTCDevice device = initializeDevice();
-	Scene * scene = new Scene(device);
-	scene->addObjectFromOBJ(model_file_path, glm::vec3(0.0f, 0.0f, 0.0f), scene_size, &device);
-	scene->commitScene();
-
-	const char* measurement_file_path = scene_doc.FirstChildElement("SCENE")->FirstChildElement("MEASUREMENT")->FirstChildElement("FILE")->GetText();
-	unsigned int measurement_length = scene_doc.FirstChildElement("SCENE")->FirstChildElement("MEASUREMENT")->FirstChildElement("LENGTH")->UnsignedText();
+	const char* measurement_file_path = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MEASUREMENT")->FirstChildElement("FILE")->GetText();
+	unsigned int measurement_length = scene_doc->FirstChildElement("SCENE")->FirstChildElement("MEASUREMENT")->FirstChildElement("LENGTH")->UnsignedText();
 
 	timeInterval interval;
-	if (scene_doc.FirstChildElement("SCENE")->FirstChildElement("ANALYZE")) {
-		unsigned int begin = scene_doc.FirstChildElement("SCENE")->FirstChildElement("ANALYZE")->FirstChildElement("BEGIN")->IntText();
-		unsigned int end = scene_doc.FirstChildElement("SCENE")->FirstChildElement("ANALYZE")->FirstChildElement("END")->IntText();
+	if (scene_doc->FirstChildElement("SCENE")->FirstChildElement("ANALYZE")) {
+		unsigned int begin = scene_doc->FirstChildElement("SCENE")->FirstChildElement("ANALYZE")->FirstChildElement("BEGIN")->IntText();
+		unsigned int end = scene_doc->FirstChildElement("SCENE")->FirstChildElement("ANALYZE")->FirstChildElement("END")->IntText();
 		interval = { begin, end };
 	}
 	else {
 		interval = { 0, 0 };
 	}
 
-	renderAudioFile(scene, listener_pos, listener_size, source_pos, source_power, measurement_file_path, measurement_length, max_reflexions, absorbtion_coef, num_rays, interval);
+	simulationEngines engines = parseEngines(scene_doc->FirstChildElement("SCENE"), scene, source_power, absorbtion_coef);
+
+	renderAudioFile(scene, listener_pos, listener_size, adaptive_listener, source_pos, source_power, measurement_file_path, measurement_length, max_reflexions, absorbtion_coef, num_rays, interval, engines.image_sources, engines.beam_tracer, engines.specular_paths, engines.path_guide, engines.late_field, engines.bidirectional, engines.synthesis, engines.hybrid_reverb, reweights, calibrate, fine_length, seed, configHash(scene_doc), checkpoint, shard, output_path, num_threads);
+
+	deleteEngines(&engines);
+	if (checkpoint) {
+		delete(checkpoint);
+	}
+}
+
+void getFileImpulseResponse(char* file_path, const std::vector<reweightSetting> & reweights, bool calibrate, const shardSetting * shard, const std::string & output_path) {
+	tinyxml2::XMLDocument scene_doc;
+
+	if (scene_doc.LoadFile(file_path)) {
+		cout << "Error loading file" << endl;
+		return;
+	}
+
+	RTCDevice device = initializeDevice();
+	Scene * scene = loadSimulationScene(&scene_doc, &device);
+	compareSimplification(&scene_doc, scene, &device);
+	simulateScene(&scene_doc, scene, output_path, 0, reweights, calibrate, shard);
+	delete(scene);
+	rtcReleaseDevice(device);
+}
+
+//Matches a file name against a pattern where * is any sequence of characters and ? any single character
+bool matchesPattern(const char * name, const char * pattern) {
+	if (!*pattern) {
+		return !*name;
+	}
+	if (*pattern == '*') {
+		return matchesPattern(name, pattern + 1) || (*name && matchesPattern(name + 1, pattern));
+	}
+	return *name && (*pattern == '?' || *pattern == *name) && matchesPattern(name + 1, pattern + 1);
+}
+
+/*Adds the simulation files of an argument of the sweep mode: a pattern with wildcards in the file name, a .txt file with
+one simulation file per line, or a simulation file.*/
+void addSweepConfigs(const std::string & argument, std::vector<std::string> * configs) {
+	std::filesystem::path path(argument);
+	std::string name = path.filename().string();
+	if (name.find_first_of("*?") != std::string::npos) {
+		std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+		std::vector<std::string> matches;
+		for (auto & entry : std::filesystem::directory_iterator(directory)) {
+			if (entry.is_regular_file() && matchesPattern(entry.path().filename().string().c_str(), name.c_str())) {
+				matches.push_back(entry.path().string());
+			}
+		}
+		std::sort(matches.begin(), matches.end());
+		configs->insert(configs->end(), matches.begin(), matches.end());
+	}
+	else if (path.extension() == ".txt") {
+		std::ifstream list(argument);
+		std::string line;
+		while (std::getline(list, line)) {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			if (!line.empty()) {
+				configs->push_back(line);
+			}
+		}
+	}
+	else {
+		configs->push_back(argument);
+	}
+}
 
+//Key of the geometry of a simulation file. Files with the same MODEL, SIZE and geometry elements share the scene.
+std::string sceneKey(tinyxml2::XMLDocument * scene_doc) {
+	tinyxml2::XMLElement * root = scene_doc->FirstChildElement("SCENE");
+	tinyxml2::XMLPrinter printer(NULL, true);
+	root->FirstChildElement("MODEL")->Accept(&printer);
+	root->FirstChildElement("SIZE")->Accept(&printer);
+	const char * geometry[] = { "SIMPLIFY", "LARGE_MESH", "OBJECT" };
+	for (int g = 0; g < 3; g++) {
+		for (tinyxml2::XMLElement * element = root->FirstChildElement(geometry[g]); element; element = element->NextSiblingElement(geometry[g])) {
+			element->Accept(&printer);
+		}
+	}
+	return printer.CStr();
+}
+
+/*Simulates every configuration with one device. Scenes are built once per distinct geometry and shared by the
+simulations, which run in num_workers threads. Each result is written to output_directory/[file name].txt, with a
+numbered suffix (_2, _3...) if another configuration already used that name.*/
+void sweep(const std::string & output_directory, const std::vector<std::string> & configs, int num_workers) {
+	std::filesystem::create_directories(output_directory);
+	RTCDevice device = initializeDevice();
+
+	std::vector<tinyxml2::XMLDocument*> docs;
+	std::vector<Scene*> scenes;
+	std::vector<std::string> output_paths;
+	std::map<std::string, Scene*> scene_cache;
+	std::set<std::string> output_names;
+	for (size_t c = 0; c < configs.size(); c++) {
+		tinyxml2::XMLDocument * scene_doc = new tinyxml2::XMLDocument();
+		if (scene_doc->LoadFile(configs[c].c_str())) {
+			cout << "Error loading file " << configs[c] << endl;
+			delete(scene_doc);
+			continue;
+		}
+		std::string key = sceneKey(scene_doc);
+		if (!scene_cache.count(key)) {
+			scene_cache[key] = loadSimulationScene(scene_doc, &device);
+		}
+		//The comparison scenes are built here, one at a time, and not by the workers
+		compareSimplification(scene_doc, scene_cache[key], &device);
+		docs.push_back(scene_doc);
+		scenes.push_back(scene_cache[key]);
+		//Configurations with the same file name in different directories would overwrite each other's result
+		std::string stem = std::filesystem::path(configs[c]).stem().string();
+		std::string name = stem;
+		for (int n = 2; output_names.count(name); n++) {
+			name = stem + "_" + std::to_string(n);
+		}
+		output_names.insert(name);
+		output_paths.push_back((std::filesystem::path(output_directory) / name).string() + ".txt");
+	}
+	cout << docs.size() << " simulations, " << scene_cache.size() << " scenes" << endl;
+
+	//The rays of a simulation are split among the threads left for its worker
+	int hardware_threads = glm::max(1, (int)std::thread::hardware_concurrency());
+	num_workers = glm::clamp(num_workers > 0 ? num_workers : hardware_threads, 1, glm::max(1, (int)docs.size()));
+	int threads_per_run = glm::max(1, hardware_threads / num_workers);
+	std::atomic<size_t> next_run(0);
+	std::vector<std::thread> workers;
+	for (int w = 0; w < num_workers; w++) {
+		workers.push_back(std::thread([&]() {
+			for (size_t run = next_run++; run < docs.size(); run = next_run++) {
+				simulateScene(docs[run], scenes[run], output_paths[run], threads_per_run, std::vector<reweightSetting>(), false, NULL);
+				cout << "Finished " << output_paths[run] << endl;
+			}
+		}));
+	}
+	for (int w = 0; w < num_workers; w++) {
+		workers[w].join();
+	}
+
+	for (auto it = scene_cache.begin(); it != scene_cache.end(); ++it) {
+		delete(it->second);
+	}
+	for (size_t d = 0; d < docs.size(); d++) {
+		delete(docs[d]);
+	}
+	rtcReleaseDevice(device);
+}
+
+//Adds up the partial results of the shards of a simulation and writes Rs to output_path like the first line of rs.txt
+void mergeShards(const std::string & output_path, const std::vector<std::string> & file_paths) {
+	castCheckpoint merged;
+	if (!mergeCheckpoints(file_paths, &merged)) {
+		return;
+	}
+	std::vector<float> rs(merged.histogram.size, 0.0f);
+	merged.histogram.expand(&rs);
+	std::ofstream rs_file(output_path);
+	rs_file << std::setprecision(7);
+	double received_energy = 0;
+	for (size_t i = 0; i < rs.size(); i++) {
+		rs_file << rs[i] << ",";
+		received_energy += rs[i];
+	}
+	rs_file << std::endl << received_energy;
+	rs_file.close();
+	cout << file_paths.size() << " shards merged into " << output_path << endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -387,7 +826,64 @@ int main(int argc, char* argv[]) {
 	if (!strcmp(mode, "simulate")) {
 		cout << "Simulating audio" << endl;
 		char* file_path = argv[2];
-		getFileImpulseResponse(file_path);
+		getFileImpulseResponse(file_path, std::vector<reweightSetting>(), false, NULL, "rs.txt");
+	}
+	else if (!strcmp(mode, "reweight")) {
+		//Every following argument is an ABSORBTION:MAX_REFLEXIONS pair for which Rs is regenerated from the same trace
+		cout << "Simulating audio" << endl;
+		char* file_path = argv[2];
+		std::vector<reweightSetting> reweights;
+		for (int i = 3; i < argc; i++) {
+			reweightSetting setting;
+			if (sscanf(argv[i], "%f:%d", &setting.absorbtion_coef, &setting.max_reflexions) != 2) {
+				cout << "Invalid setting " << argv[i] << endl;
+				return 1;
+			}
+			reweights.push_back(setting);
+		}
+		getFileImpulseResponse(file_path, reweights, false, NULL, "rs.txt");
+	}
+	else if (!strcmp(mode, "calibrate")) {
+		cout << "Calibrating absorption" << endl;
+		char* file_path = argv[2];
+		getFileImpulseResponse(file_path, std::vector<reweightSetting>(), true, NULL, "rs.txt");
+	}
+	else if (!strcmp(mode, "sweep")) {
+		//sweep [output directory] [-j workers] [simulation files, patterns or lists]...
+		cout << "Simulating audio" << endl;
+		std::string output_directory = argv[2];
+		int num_workers = 0;
+		std::vector<std::string> configs;
+		for (int i = 3; i < argc; i++) {
+			if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+				num_workers = atoi(argv[++i]);
+			}
+			else {
+				addSweepConfigs(argv[i], &configs);
+			}
+		}
+		sweep(output_directory, configs, num_workers);
+	}
+	else if (!strcmp(mode, "shard")) {
+		//shard [simulation file] [first ray] [rays] [seed] [partial result file]
+		cout << "Simulating audio" << endl;
+		char* file_path = argv[2];
+		shardSetting shard;
+		if (argc < 7 || sscanf(argv[3], "%llu", &shard.first_ray) != 1 || sscanf(argv[4], "%llu", &shard.count) != 1
+			|| sscanf(argv[5], "%llu", &shard.seed) != 1) {
+			cout << "Invalid shard" << endl;
+			return 1;
+		}
+		getFileImpulseResponse(file_path, std::vector<reweightSetting>(), false, &shard, argv[6]);
+	}
+	else if (!strcmp(mode, "merge")) {
+		//merge [output file] [partial result files]...
+		if (argc < 4) {
+			cout << "Usage: merge [output file] [partial result files]..." << endl;
+			return 1;
+		}
+		std::vector<std::string> file_paths(argv + 3, argv + argc);
+		mergeShards(argv[2], file_paths);
 	}
 	else if (!strcmp(mode, "auralize")) {
 		cout << "Auralizing audio" << endl;